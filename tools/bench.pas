@@ -0,0 +1,93 @@
+{ INCLUDE-FILE BENCH.PAS: }
+{ time track reads with different sector interleave }
+
+
+Procedure Bench; { read tracks with interleave 1..n, recommend the best }
+Var
+  Skew, MaxSkew, Best, Trk, Line: integer;
+  t, Secs, BestSecs, Bytes:       real;
+  Ok:                             boolean;
+begin
+  if UserFrame( BenchTracks ) = 'N' then
+    Exit;  { user abort }
+  BufferValid := False;
+  if not TrackFits then
+    begin
+      GotoXY( 1, USRLINE + 6 );
+      Write( 'Track too large for buffer.' );
+      Exit
+    end;
+  GotoXY( 1, USRLINE + 5 );
+  Write( 'INTERLEAVE   SECONDS     KB/s' );
+  Bytes := ( LastTrack - FirstTrack + 1.0 ) * PhySecs * Psize;
+  MaxSkew := PhySecs div 2;
+  if MaxSkew < 1 then MaxSkew := 1;
+  if MaxSkew > BOTLINE - USRLINE - 6 then MaxSkew := BOTLINE - USRLINE - 6;
+  Best := 0;
+  BestSecs := 0.0;
+  Ok := true;
+  Skew := 1;
+  while Ok and ( Skew <= MaxSkew ) do
+    begin
+      Line := USRLINE + 5 + Skew;
+      GotoXY( 1, Line );
+      Write( Skew:6 );
+      Interleave := Skew;
+      InitOrder;
+      if not Tick( t ) then  { start at a clock edge }
+        begin
+          Write( '  no clock' );
+          Ok := false
+        end
+      else
+        begin
+          Trk := FirstTrack;
+          while Ok and ( Trk <= LastTrack ) do
+            begin
+              Ok := TrackIO( 13, Trk, Psize ) = 0;
+              if Ok then Trk := Trk + 1
+            end;
+          Secs := Clock - t;
+          if Ok then
+            begin
+              if Secs < 1.0 then Secs := 1.0;   { one second resolution }
+              Write( Secs:12:0, Bytes / 1024.0 / Secs:10:1 );
+              if ( Best = 0 ) or ( Secs < BestSecs ) then
+                begin
+                  Best := Skew;
+                  BestSecs := Secs
+                end
+            end
+          else
+            Write( '  read error at track ', Trk )
+        end;
+      Skew := Skew + 1
+    end;
+  if Best > 0 then
+    begin
+      Interleave := Best;  { used by FORMAT and all track transfers }
+      InitOrder;
+      GotoXY( 40, USRLINE + 6 );
+      Write( 'Recommended interleave: ', Best );
+      if PhySecs <= 32 then
+        begin
+          GotoXY( 40, USRLINE + 7 );
+          Write( 'Translation table:' );
+          Line := USRLINE + 7;
+          for i := 0 to PhySecs - 1 do
+            begin                      { log. -> phys. sector }
+              if i mod 8 = 0 then
+                begin
+                  Line := Line + 1;
+                  GotoXY( 40, Line )
+                end;
+              Write( AccTab[i]:4 )
+            end
+        end
+    end
+  else
+    begin
+      Interleave := 0;     { back to the BIOS order }
+      InitOrder
+    end
+end;
@@ -0,0 +1,291 @@
+{ INCLUDE-FILE DIRMAP.PAS: }
+{ decoded directory, block allocation map and fragmentation report }
+
+{ All directory tracks are read with whole track transfers and each  }
+{ 32 byte entry is decoded once.  Owner[] maps every block to the    }
+{ file using it, a file's fragments are its runs of adjacent blocks. }
+{ Owner[] shares TrackBuf with the directory track: the track is     }
+{ read into the lower MaxDirTrack bytes, the map takes the rest.     }
+
+
+Const
+  MaxBlock = 4095;     { highest block number of the map }
+  MaxFiles = 256;      { files in the list }
+  MaxDirTrack = 8192;  { MaxTrackSize - 2 * ( MaxBlock + 1 ) }
+
+Type
+  File_t = record
+    Name:    string[12];
+    User:    byte;
+    Entries,                 { directory entries (extents)   }
+    Blocks,                  { allocated blocks              }
+    Runs,                    { runs of adjacent blocks       }
+    FirstEx,                 { lowest extent number seen     }
+    First:   integer         { first block of that extent    }
+  end;
+
+Var
+  DirMem: record
+    DirTrk: array [1..MaxDirTrack] of byte;   { directory track     }
+    Owner:  array [0..MaxBlock] of integer    { 0 free, -1 directory, }
+  end absolute TrackBuf;                      { -2 not in list, else file }
+  Files:  array [1..MaxFiles] of File_t;
+  NFiles: integer;
+
+
+Procedure AddEntry( p: integer ); { decode directory entry at TrackBuf[p] }
+Var
+  Name:     string[12];
+  f, n, b,
+  Ex, Fb:   integer;
+  Found:    boolean;
+begin
+  if TrackBuf[p] <= 15 then               { user 0..15: file entry }
+    begin
+      Name := '';
+      for n := 1 to 11 do
+        begin
+          if n = 9 then Name := Name + '.';
+          if TrackBuf[p+n] and $7F <> $20 then
+            Name := Name + chr( TrackBuf[p+n] and $7F ) { no attributes }
+        end;
+      f := NFiles;                        { extents are mostly adjacent }
+      Found := false;
+      while ( f > 0 ) and not Found do
+        if ( Files[f].User = TrackBuf[p] ) and ( Files[f].Name = Name ) then
+          Found := true
+        else
+          f := f - 1;
+      if not Found then
+        if NFiles < MaxFiles then
+          begin
+            NFiles := NFiles + 1;
+            f := NFiles;
+            Files[f].Name := Name;
+            Files[f].User := TrackBuf[p];
+            Files[f].Entries := 0;
+            Files[f].Blocks := 0;
+            Files[f].Runs := 0;
+            Files[f].FirstEx := MaxInt;
+            Files[f].First := 0
+          end
+        else
+          f := -2;                        { list full, map only }
+      Ex := TrackBuf[p+12] + 32 * TrackBuf[p+14];   { EX + 32 * S2 }
+      Fb := 0;
+      for n := 0 to 15 do
+        begin
+          if ptr^.DSM > 255 then          { 16 bit block numbers }
+            if odd( n ) then
+              b := 0
+            else
+              b := TrackBuf[p+16+n] + TrackBuf[p+17+n] shl 8
+          else
+            b := TrackBuf[p+16+n];
+          if ( b > 0 ) and ( b <= ptr^.DSM ) then
+            begin
+              DirMem.Owner[b] := f;
+              if Fb = 0 then Fb := b;
+              if f > 0 then Files[f].Blocks := Files[f].Blocks + 1
+            end
+        end;
+      if f > 0 then
+        with Files[f] do
+          begin
+            Entries := Entries + 1;
+            if Ex < FirstEx then
+              begin
+                FirstEx := Ex;
+                First := Fb
+              end
+          end
+    end
+end;
+
+
+Function ReadDir: boolean; { read all directory entries, build Owner[] }
+Var
+  b, t, s, e, Rec: integer;
+  Ok:              boolean;
+begin
+  NFiles := 0;
+  with ptr^ do
+    begin
+      for b := 0 to DSM do
+        DirMem.Owner[b] := 0;
+      for b := 0 to 7 do                  { directory blocks }
+        begin
+          if AL0 and ( $80 shr b ) <> 0 then DirMem.Owner[b] := -1;
+          if AL1 and ( $80 shr b ) <> 0 then DirMem.Owner[b+8] := -1
+        end;
+      Ok := true;
+      Rec := 0;
+      t := DirTrack;
+      while Ok and ( Rec < DirNum div 4 ) do
+        begin
+          Ok := TrackIO( 13, t, Psize ) = 0;
+          s := 0;
+          while Ok and ( s < SPT ) and ( Rec < DirNum div 4 ) do
+            begin                         { log. sector s in TrackBuf }
+              i := 1 + ( SkewTab[s div LogPerPhy] - PhyBase ) * Psize
+                     + ( s mod LogPerPhy ) * 128;
+              for e := 0 to 3 do
+                AddEntry( i + 32 * e );
+              s := s + 1;
+              Rec := Rec + 1
+            end;
+          t := t + 1
+        end;
+      for b := 1 to DSM do                { count runs of each file }
+        if DirMem.Owner[b] > 0 then
+          if DirMem.Owner[b] <> DirMem.Owner[b-1] then
+            Files[DirMem.Owner[b]].Runs := Files[DirMem.Owner[b]].Runs + 1
+    end;
+  ReadDir := Ok
+end;
+
+
+Procedure DirMap; { list files or show the allocation map }
+Var
+  Mode:         char;
+  f, n, Frag,
+  Used, Free,
+  Line, Per:    integer;
+  r:            real;
+  st:           string[5];
+
+Procedure ShowFile( f, x, y: integer );
+begin
+  GotoXY( x, y );
+  with Files[f] do
+    begin
+      if Runs > 1 then HighVideo else LowVideo;
+      Write( f:3, User:3, ':', Name, ' ':13-length( Name ), Entries:4,
+             Blocks * ( ( ptr^.BLM + 1 ) div 8 ):6, 'K', Runs:5 )
+    end;
+  HighVideo
+end;
+
+begin
+  Mode := UserFrame( DirTracks ); { No / List / Map }
+  if Mode = 'N' then
+    Exit;  { user abort }
+  BufferValid := False;
+  GotoXY( 1, USRLINE + 4 );
+  if PhySecs > MaxDirTrack div Psize then
+    begin
+      Write( 'Track too large for buffer.' );
+      Exit
+    end;
+  if ptr^.DSM > MaxBlock then
+    begin
+      Write( 'Too many blocks for the map.' );
+      Exit
+    end;
+  if not ReadDir then
+    begin
+      Write( 'Read error in directory.' );
+      Exit
+    end;
+
+  Frag := 0;
+  Used := 0;
+  for f := 1 to NFiles do
+    if Files[f].Runs > 1 then Frag := Frag + 1;
+  for n := 0 to ptr^.DSM do
+    if DirMem.Owner[n] <> 0 then Used := Used + 1;
+  Free := ptr^.DSM + 1 - Used;
+  Write( NFiles, ' files, ', Frag, ' fragmented, ',
+         Free * ( ( ptr^.BLM + 1 ) div 8 ), 'K free' );
+
+  if Mode = 'L' then
+    begin           { two columns, fragmented files highlighted }
+      f := 1;
+      repeat
+        ClrFromTo( USRLINE + 5, BOTLINE );
+        GotoXY( 1, USRLINE + 5 );
+        LowVideo;
+        Write( ' NO US NAME          EXT   SIZE RUNS' );
+        GotoXY( 41, USRLINE + 5 );
+        Write( ' NO US NAME          EXT   SIZE RUNS' );
+        HighVideo;
+        Line := USRLINE + 6;
+        while ( f <= NFiles ) and ( Line < BOTLINE - 1 ) do
+          begin
+            ShowFile( f, 1, Line );
+            f := f + 1;
+            if f <= NFiles then
+              ShowFile( f, 41, Line );
+            f := f + 1;
+            Line := Line + 1
+          end;
+        GotoXY( 1, BOTLINE );
+        if f <= NFiles then
+          Write( 'SHOW FILE NO.  (RET = more, Q = quit): ' )
+        else
+          Write( 'SHOW FILE NO.  (RET = quit): ' );
+        readln( st );
+        n := 0;                           { RET: next page }
+        if st <> '' then
+          begin
+            Val( st, n, i );
+            if i <> 0 then n := -1        { Q or no number: quit }
+          end;
+        if ( n > 0 ) and ( n <= NFiles ) then
+          if Files[n].First > 0 then
+            with ptr^ do
+              begin          { go to the first data sector of the file }
+                r := Files[n].First * ( BLM + 1.0 );  { 128 byte record }
+                if OFF + trunc( r / SPT ) < MaxTrack then
+                  begin
+                    Track := OFF + trunc( r / SPT );
+                    Lsector := round( r - ( Track - OFF ) * 1.0 * SPT );
+                    ClrFromTo( USRLINE, BOTLINE );
+                    DoDisk( NextSector );
+                    Exit
+                  end
+              end
+      until ( n <> 0 ) or ( f > NFiles );
+      ClrFromTo( USRLINE + 5, BOTLINE )
+    end
+  else
+    begin           { one char per Per blocks, 64 x 12 chars }
+      Per := ptr^.DSM div 768 + 1;
+      GotoXY( 1, USRLINE + 5 );
+      LowVideo;
+      Write( Per, ' block(s) per char:  D directory  # used  + partly used  . free' );
+      HighVideo;
+      Line := USRLINE + 5;
+      n := 0;
+      while n <= ptr^.DSM do
+        begin
+          if n mod ( 64 * Per ) = 0 then
+            begin
+              Line := Line + 1;
+              GotoXY( 1, Line );
+              LowVideo;
+              Write( n:5, ': ' );
+              HighVideo
+            end;
+          Used := 0;
+          Free := 0;
+          for f := n to n + Per - 1 do
+            if f <= ptr^.DSM then
+              if DirMem.Owner[f] = 0 then
+                Free := Free + 1
+              else if DirMem.Owner[f] = -1 then
+                Used := -MaxInt           { any dir. block marks it }
+              else
+                Used := Used + 1;
+          if Used < 0 then
+            Write( 'D' )
+          else if Free = 0 then
+            Write( '#' )
+          else if Used = 0 then
+            Write( '.' )
+          else
+            Write( '+' );
+          n := n + Per
+        end
+    end
+end;
@@ -54,6 +54,11 @@ Type
   end;
   CMDtype = set of Char;
   RWtype = ( FormatTracks,
+            ImageTracks,
+            BenchTracks,
+            DirTracks,
+            SearchTracks,
+            ScanTracks,
             ReadSector,
             NextSector,
             PreviousSector,
@@ -82,6 +87,7 @@ Var
 
 {$I UBIOS.PAS }  { external funktion UBIOS for BIOS calls }
 {$I HEXIO.PAS }  { ext. funkt. HEXVAL, ext. procedure WRITEHEX }
+{$I TRACKIO.PAS } { whole track transfers, sector skew table }
 
 
 Procedure ShowHeader;
@@ -173,6 +179,28 @@ begin
       Write( 'rite, ' );
       Xpos := Xpos + 7
     end;
+  GotoXY( 17, CMDLINE + 1 );      { track oriented tools }
+  ClrEol;
+  HighVideo;
+  Write( 'I' );
+  LowVideo;
+  Write( 'mage, ' );
+  HighVideo;
+  Write( 'B' );
+  LowVideo;
+  Write( 'enchmark, ' );
+  HighVideo;
+  Write( 'D' );
+  LowVideo;
+  Write( 'irectory, ' );
+  HighVideo;
+  Write( 'S' );
+  LowVideo;
+  Write( 'earch, ' );
+  HighVideo;
+  Write( 'T' );
+  LowVideo;
+  Write( 'est' );
   HighVideo;
   repeat
     GotoXY( Xpos-2, CMDLINE );
@@ -198,8 +226,9 @@ end;
 Function UserFrame( Mode: RWtype ): Char; { screen mask and data input }
 Var
   Result : Char;
+  Choices: CMDtype;
 begin
-  if Mode = FormatTracks then
+  if Mode in [ FormatTracks, ImageTracks, BenchTracks, DirTracks, SearchTracks, ScanTracks ] then
     ClrFromTo( USRLINE, BOTLINE );
   LowVideo;
   ShowHeader;
@@ -208,7 +237,12 @@ begin
     ReadSector:   Write( 'READ  ' );
     NextSector:   Write( 'READ  ' );
     WriteSector:  Write( 'WRITE ' );
-    FormatTracks: Write( 'FORMAT' )
+    FormatTracks: Write( 'FORMAT' );
+    ImageTracks:  Write( 'IMAGE ' );
+    BenchTracks:  Write( 'BENCH ' );
+    DirTracks:    Write( 'DIR   ' );
+    SearchTracks: Write( 'SEARCH' );
+    ScanTracks:   Write( 'TEST  ' )
   end;
   HighVideo;
   DriveChr := chr( Drive + $41 );    { 0..15 -> 'A'..'P' }
@@ -244,10 +278,11 @@ begin
       Psize := 128 shl PSH;
       LogPerPhy := 1 shl PSH;
       DataTrack := DirTrack + ( DRM div 4 div SPT ) + 1;
+      InitSkew;
       k := ( DSM + 1 ) * ( ( BLM + 1 ) div 8 );
       GotoXY( 49, USRLINE );
       Write( k:5, ' KB capacity, ', DirNum, ' dir.' );
-      MaxTrack := round( ( k / SPT ) * 8 + OFF );
+      MaxTrack := trunc( ( k * 8.0 + SPT - 1 ) / SPT ) + OFF;  { with partial last track }
       GotoXY( 49, USRLINE + 1 );
       Write( MaxTrack:5, ' tracks, ', DirTrack, ' reserv.' );
       GotoXY( 49, USRLINE + 2 );
@@ -262,33 +297,80 @@ begin
 
       if Track < 0 then
         Track := DirTrack;
-      if Mode = FormatTracks then
+      if Mode in [ FormatTracks, ImageTracks, BenchTracks, DirTracks, SearchTracks, ScanTracks ] then
         begin
-          FirstTrack := DirTrack;
-          LastTrack := DataTrack - 1;
-          repeat
-            GotoXY( 13, USRLINE + 1 );
-            Write( 'FIRST TRACK     (0 ..',(MaxTrack -1): 4, '): ' );
-            Write( FirstTrack, chr( 8 ) );
-            if FirstTrack > 9  then Write( chr( 8 ) );
-            if FirstTrack > 99 then Write( chr( 8 ) );
-            readln( FirstTrack )
-          until ( FirstTrack >= 0 ) and ( FirstTrack < MaxTrack );
-          LastTrack := FirstTrack;
-          repeat
-            GotoXY( 13, USRLINE + 2 );
-            Write( 'LAST TRACK      (', FirstTrack, ' ..',(MaxTrack -1): 4, '): ' );
-            Write( LastTrack, chr( 8 ) );
-            if LastTrack > 9  then Write( chr( 8 ) );
-            if LastTrack > 99 then Write( chr( 8 ) );
-            readln( LastTrack )
-          until ( LastTrack >= FirstTrack ) and ( LastTrack < MaxTrack );
+          if Mode = DirTracks then
+            begin                      { directory tracks only }
+              FirstTrack := DirTrack;
+              LastTrack := DataTrack - 1
+            end
+          else
+            begin
+              if Mode in [ ImageTracks, ScanTracks ] then
+                FirstTrack := 0
+              else
+                FirstTrack := DirTrack;
+              repeat
+                GotoXY( 13, USRLINE + 1 );
+                Write( 'FIRST TRACK     (0 ..',(MaxTrack -1): 4, '): ' );
+                Write( FirstTrack, chr( 8 ) );
+                if FirstTrack > 9  then Write( chr( 8 ) );
+                if FirstTrack > 99 then Write( chr( 8 ) );
+                readln( FirstTrack )
+              until ( FirstTrack >= 0 ) and ( FirstTrack < MaxTrack );
+              case Mode of
+                FormatTracks: LastTrack := FirstTrack;
+                ImageTracks,
+                SearchTracks,
+                ScanTracks:   LastTrack := MaxTrack - 1;
+                BenchTracks:  begin            { enough for a few seconds }
+                                LastTrack := FirstTrack + 9;
+                                if LastTrack >= MaxTrack then
+                                  LastTrack := MaxTrack - 1
+                              end
+              end;
+              repeat
+                GotoXY( 13, USRLINE + 2 );
+                Write( 'LAST TRACK      (', FirstTrack, ' ..',(MaxTrack -1): 4, '): ' );
+                Write( LastTrack, chr( 8 ) );
+                if LastTrack > 9  then Write( chr( 8 ) );
+                if LastTrack > 99 then Write( chr( 8 ) );
+                readln( LastTrack )
+              until ( LastTrack >= FirstTrack ) and ( LastTrack < MaxTrack )
+            end;
           Result := 'N';
           GotoXY( 1, USRLINE + 3 );
-          Write( 'PROCEED?    (N)o  (F)ormat  (I)nitdir : ', Result, chr(8) );
+          Write( 'PROCEED?    (N)o  ' );
+          case Mode of
+            FormatTracks: begin
+                            Write( '(F)ormat  (I)nitdir' );
+                            Choices := ['F', 'I']
+                          end;
+            ImageTracks:  begin
+                            Write( '(D)ump (R)estore (V)erify (C)rc (U)pdate (A)pply' );
+                            Choices := ['D', 'R', 'V', 'C', 'U', 'A']
+                          end;
+            BenchTracks:  begin
+                            Write( '(B)enchmark' );
+                            Choices := ['B']
+                          end;
+            DirTracks:    begin
+                            Write( '(L)ist  (M)ap' );
+                            Choices := ['L', 'M']
+                          end;
+            SearchTracks: begin
+                            Write( '(S)earch' );
+                            Choices := ['S']
+                          end;
+            ScanTracks:   begin
+                            Write( '(T)est, read only' );
+                            Choices := ['T']
+                          end
+          end;
+          Write( ' : ', Result, chr(8) );
           readln( Result );
           Result := UpCase( Result );
-          if (Result <> 'F') and (Result <> 'I') then
+          if not ( Result in Choices ) then
             Result := 'N';
           UserFrame := Result
         end
@@ -368,91 +450,109 @@ end;
 
 Procedure Format; { format tracks }
 Var
-  Ftrack : integer;
-  FormatType : char;
+  Ftrack, Stride : integer;
+  FormatType, BufType : char;
   InfoString : String[13];
 
 Procedure InitBuffer( INITDIR : Boolean);
+{ prepare the whole track if it fits, else one phys. sector }
 begin
-  for i := 1 to Psize do           { fill phys. sector }
+  if TrackFits then Stride := Psize else Stride := 0;
+  for i := 1 to Psize + ( PhySecs - 1 ) * Stride do
     if INITDIR and (i mod $80 = $61) then  { INITDIR timestamp }
-      PhySecBuf[i] := $21   { '!' for file date }
+      TrackBuf[i] := $21   { '!' for file date }
     else
-      PhySecBuf[i] := $E5;  { erased data }
+      TrackBuf[i] := $E5;  { erased data }
 end;
 
 begin
   FormatType := UserFrame( FormatTracks ); { No / Format / Initdir }
   if FormatType = 'N' then
     Exit;  { user abort }
+  repeat
+    GotoXY( 1, USRLINE + 4 );
+    Write( 'INTERLEAVE  (0 = BIOS, 1 ..', PhySecs - 1, '): ', Interleave, chr( 8 ) );
+    if Interleave > 9 then Write( chr( 8 ) );
+    readln( Interleave )
+  until ( Interleave >= 0 ) and ( Interleave < PhySecs );
+  InitOrder;                       { write sectors in this order }
   i := UBIOS( 9, 0, Drive, 1, 0 ); { selekt disk }
   BufferValid := False;            { do not show buffer after formatting }
+  BufType := ' ';                  { TrackBuf not yet prepared }
   for Ftrack := FirstTrack to LastTrack do
     begin
-      if (Ftrack < DirTrack) or (Ftrack = DataTrack) then
+      if (Ftrack < DirTrack) or (Ftrack >= DataTrack) then
         begin
-          InitBuffer( False );
+          if BufType <> 'F' then
+            InitBuffer( False );
+          BufType := 'F';
           InfoString := 'FORMAT track '
         end
-      else if Ftrack = DirTrack then
-             begin
-               InitBuffer( True );
-               InfoString := 'INITDIR track'
-             end;
+      else  { directory tracks }
+        begin
+          if BufType <> 'I' then
+            InitBuffer( True );
+          BufType := 'I';
+          InfoString := 'INITDIR track'
+        end;
       GotoXY( 1, USRLINE + 5 );
       Write( InfoString , Ftrack:3 );
-      for Psector := 0 to ( MaxSector div LogPerPhy ) - 1 do
-        begin
-          i := UBIOS( 23, 0, 1, 0, 0 );                { execute 1 sector   }
-          i := UBIOS( 10, 0, Ftrack, 0, 0 );           { select track       }
-          i := UBIOS( 11, 0, Psector, 0, 0 );          { select sector      }
-          i := UBIOS( 12, 0, Addr( PhySecBuf ), 0, 0); { select DMA address }
-          i := UBIOS( 28, 1, 0, 0, 0 );                { select RAM bank    }
-          i := UBIOS( 14, 0, 0, 0, 0 );                { write phys. sector }
-          if i <> 0 then Error( 2 )
-        end
+      if TrackIO( 14, Ftrack, Stride ) <> 0 then { write phys. sectors }
+        Error( 2 )
     end;
   ClrFromTo( USRLINE, BOTLINE )
 end;
 
 
 Procedure DisplaySector; { show log. sector content on screen }
+{ each line is built in a string and written with one call, the video }
+{ attribute is switched only at the borders of dimmed character runs  }
+Var
+  Line: string[80];
+  Dim:  boolean;  { LowVideo is active }
 begin
   ClrFromTo( INFOLINE, BOTLINE );
   GotoXY( 1, USRLINE + 5 );
   LowVideo;
-  Write( '   ' );
+  Line := '   ';
   for i := 0 to 15 do
+    Line := Line + ' ' + HexTab[i];
+  writeln( Line );
+  Dim := true;
+  for i := 0 to 7 do
     begin
-      Write( ' ' );
-      WriteHex( i )
-    end;
-  HighVideo;
-  writeln;
-  for i := 1 to 8 do
-    begin
-      LowVideo;
-      WriteHex( (i-1) * 16);
-      Write( ':' );
+      if not Dim then LowVideo;
+      Write( HexTab[16 * i], ':' );
       HighVideo;
-      for j := 1 to 16 do
+      Dim := false;
+      Line[0] := chr( 51 );
+      for j := 0 to 15 do
         begin
-          k := LogSecBuf [16 *( i - 1) + j];
-          Write( ' ' );
-          WriteHex( k )                { (1) as HEX number }
+          k := LogSecBuf[16 * i + j + 1];
+          Line[3 * j + 1] := ' ';
+          Line[3 * j + 2] := HexTab[k][1];   { (1) as HEX number }
+          Line[3 * j + 3] := HexTab[k][2]
         end;
-      Write( '   ' );
+      Line[49] := ' ';
+      Line[50] := ' ';
+      Line[51] := ' ';
       for j := 1 to 16 do
         begin
-          k := LogSecBuf[16 *( i - 1) + j];
-          if k > 128 then LowVideo;
+          k := LogSecBuf[16 * i + j];
+          if ( k > 128 ) <> Dim then       { start of a new run }
+            begin
+              Write( Line );
+              Line := '';
+              Dim := not Dim;
+              if Dim then LowVideo else HighVideo
+            end;
           k := k mod 128;
-          if k < 32 then Write( '.' )  { (2) as ASCII character }
-          else Write( chr(k) );        { control char. as dot }
-          HighVideo
+          if k < 32 then Line := Line + '.'  { (2) as ASCII character }
+          else Line := Line + chr( k )       { control char. as dot }
         end;
-      writeln
+      writeln( Line )
     end;
+  if Dim then HighVideo
 end;
 
 
@@ -520,6 +620,13 @@ begin
 end;
 
 
+{$I IMAGE.PAS }  { image dump / restore / verify }
+{$I BENCH.PAS }  { interleave benchmark }
+{$I DIRMAP.PAS } { directory list, allocation map }
+{$I SEARCH.PAS } { pattern search }
+{$I SCAN.PAS }   { surface test }
+
+
 begin { MAIN PROGRAMM }
   ClrScr;
   i := BdosHL( 12 ); { funktion 12: version number of operating systems }
@@ -531,16 +638,19 @@ begin { MAIN PROGRAMM }
   Track := -1;                 { invalid }
   Lsector := 0;
   BufferValid := false;
+  CrcReady := false;
+  InitHex;                     { hex table for DisplaySector }
+  Interleave := 0;             { sector order from BIOS table }
   LastCmd := chr($FF);
 
   repeat
     if BufferValid then
       begin
         DisplaySector;
-        Cmd := GetCommand( ['Q', 'F', 'R', 'N', 'P', 'M', 'W'] )
+        Cmd := GetCommand( ['Q', 'F', 'R', 'N', 'P', 'M', 'W', 'I', 'B', 'D', 'S', 'T'] )
       end
     else
-      Cmd := GetCommand( ['Q', 'F', 'R'] );
+      Cmd := GetCommand( ['Q', 'F', 'R', 'I', 'B', 'D', 'S', 'T'] );
 
     case  Cmd of 
       'R':
@@ -578,9 +688,19 @@ begin { MAIN PROGRAMM }
       'W':
            DoDisk( WriteSector );
       'F':
-           Format
+           Format;
+      'I':
+           Image;
+      'B':
+           Bench;
+      'D':
+           DirMap;
+      'S':
+           Search;
+      'T':
+           Scan
     end;
-    if Cmd = 'R' then
+    if ( Cmd = 'R' ) or ( ( Cmd = 'D' ) and BufferValid ) then  { D: file data shown }
       LastCmd := 'N'
     else
       LastCmd := Cmd;
@@ -26,7 +26,29 @@ CR		equ	0DH
 LF		equ	0AH
 EOF		equ	1AH
 
-MAX_FILES_CNT	equ	512
+BATCH		equ	64	;file names searched in one go
+NREC		equ	128	;records read into the buffer at once
+HALF		equ	NREC*128 ;bytes of the buffer, half of the -z window
+
+OPT_N		equ	1	;-n: show matching lines with numbers
+OPT_C		equ	2	;-c: count matching lines
+OPT_F		equ	4	;-f: strings from a file
+OPT_I		equ	8	;-i: ignore case
+OPT_E		equ	16	;-e: the string is a regular expression
+OPT_Z		equ	32	;-z: search the members of ZIP and gzip files
+
+MAXPAT		equ	32	;strings of the -f file
+PATSIZE		equ	2048	;their text
+MAXNODE		equ	1200	;nodes of the automaton, the -f area fills
+				; the -z window behind Buf
+NODE		equ	10	;bytes per node:
+				; +0 char, +1 string ending here (1..MAXPAT),
+				; +2 first child, +4 next sibling,
+				; +6 fail link, +8 next node with a string
+				; ending on the fail links (dict link)
+MAXPOS		equ	32	;positions of the regular expression
+MAXSTATE	equ	127	;DFA states, bit 7 of a next state marks a match
+MEMLEN		equ	64	;chars of a member name kept
 
 ;
 ;	CP/M Command line structure
@@ -39,15 +61,121 @@ CommLine	equ	80H
 	psect	BSS
 
 Eof:		defs	1	;1=EOF reached
+Opts:		defs	1	;OPT_N, OPT_C, OPT_F, OPT_I, OPT_E, OPT_Z, 0=file names only
+Pending:	defs	1	;1=matching line goes on in the next fill
+LineNo:		defs	2	;number of the line at LineStart
+LineStart:	defs	2	;start of the current line
+Counted:	defs	2	;LFs are counted up to here
+Hits:		defs	2	;matching lines of this file
 max:		defs	1
 len:		defs	1
 String:		defs	128	;string to be searched
-Buf1:		defs	128	;used at string search
-Buf2:		defs	128	;used at string search
-		defs	1	;EOF marker must be stored here
-FileNames:	defs	11 * MAX_FILES_CNT	;store matching file names
+Args:		defs	128	;copy of the command tail
+		defs	128	;tail of the previous fill is kept here
+Buf:		defs	HALF	;file buffer, used at string search
+		defs	1	;-e stores a LF behind the data
+PatText:	defs	PATSIZE	;the strings, each ends with zero
+Queue:		defs	MAXNODE*2
+Nodes:		defs	MAXNODE*NODE	;root first
+				;-z: Buf up to here is the window
+BufStart:	defs	2	;start of the data read
+BufEnd:		defs	2	;end of the data read
+NextBuf:	defs	2	;start of the next fill
+Multi:		defs	1	;1=BDOS 44 multi-sector read (CP/M 3)
+SkipBuf:	defs	767	;holds the page aligned skip and fold tables
+SkipPage:	defs	1	;high byte of the skip table
+FoldPage:	defs	1	;high byte of the fold table
+LastSkip:	defs	1	;skip for the last char of the string
+StrLast:	defs	2	;points to the char before the last one
+PatCnt:		defs	1	;strings read from the -f file
+PatPtr:		defs	2	;end of their text
+PatStart:	defs	2	;start of the string read now
+Found:		defs	MAXPAT/8 ;bit set for each string found in the file
+AcState:	defs	2	;node of the automaton
+NodePtr:	defs	2	;next free node
+QHead:		defs	2	;queue to build the fail links
+QTail:		defs	2
+FileNames:	defs	11 * BATCH	;store matching file names
 FilesCnt:	defs	2
 FilesPointer:	defs	2
+DirCnt:		defs	2	;entries found by this directory search
+DirDone:	defs	2	;entries of the batches before
+AllDrv:		defs	1	;*: search drives A: .. P:
+UserGiven:	defs	1	;[Unn] or [U*] given
+UserLo:		defs	1	;user areas to search
+UserHi:		defs	1
+UserCur:	defs	1	;user area searched now
+OrgUser:	defs	1	;user area at start
+AnyFile:	defs	1	;a file name matched
+RePtr:		defs	2	;-e: next char of the expression
+RecSp:		defs	2	;top of the record stack
+RePos:		defs	1	;positions used
+RFirst:		defs	4	;positions a match may start with,
+RLast:		defs	4	; end with
+RNull:		defs	1	; 1=matches the empty string
+RCur:		defs	4	;positions stepped from
+RNext:		defs	4	; and reached
+RState:		defs	4	;NFA: positions reached in the file
+BolSet:		defs	4	;positions reached by the line start
+Follow:		defs	MAXPOS*4 ;positions that may follow each position
+NClass:		defs	1	;byte classes
+LfClass:	defs	1	;class of LF, the line start
+CrClass:	defs	1	;class of CR, the line end
+ClsByte:	defs	1	;byte classified now
+TbP:		defs	1	;page and follow set of the union built now
+TbF:		defs	2
+TbPage:		defs	1	;first page of the follow unions
+DfaPage:	defs	1	;first page of the DFA
+NStates:	defs	1	;DFA states
+DfaS:		defs	1	;state and class built now
+DfaK:		defs	1
+ReMode:		defs	1	;0=DFA, 1=NFA
+ReState:	defs	1	;DFA state
+AllMatch:	defs	1	;1=each line matches
+Arc:		defs	1	;-z: 0=plain file, 1=ZIP, 2=gzip
+ArcErr:		defs	1	;1=bad data in the archive
+ZFlags:		defs	1	;ZIP: bit 3=sizes behind the data; gzip: header flags
+ZMethod:	defs	1	;0=stored, 8=deflated
+CSize:		defs	4	;compressed size of the member
+CLeft:		defs	4	;bytes of it not read yet
+InPtr:		defs	2	;next byte in TBUFF
+InEof:		defs	1	;1=read behind the end of the archive
+MemName:	defs	MEMLEN	;name of the member
+OutPtr:		defs	2	;next byte of the window
+HalfEnd:	defs	2	;end of the half of the window filled now
+GrepSp:		defs	2	;stack of the search
+InfSp:		defs	2	; and of the inflater
+		defs	256
+InfTop:				;stack of the inflater
+BitBuf:		defs	1	;bits not used yet
+BitCnt:		defs	1
+Last:		defs	1	;1=last block of the stream
+NLen:		defs	2	;literal/length codes
+NDist:		defs	2	;distance codes
+NAll:		defs	2
+LPtr:		defs	2	;next code length read
+CopyLen:	defs	2	;length of a copy
+DecTab:		defs	2	;Decode: table,
+DecCnt:		defs	2	; count of the current length,
+DecIdx:		defs	2	; index of its first symbol
+DecLen:		defs	1	; lengths left
+CTab:		defs	2	;Construct: table,
+CLen:		defs	2	; code lengths
+CN:		defs	2	; and their number
+Offs:		defs	32	;first symbol of each length
+Lens:		defs	320	;code lengths of literal/length and distance codes
+LenTab:		defs	32+288*2 ;literal/length code: counts, symbols
+DistTab:	defs	32+32*2	;distance code
+;
+;	-e uses the areas of -f
+;
+PosCls		equ	PatText		;bytes of each position, 32 each
+ClassSet	equ	PatText+MAXPOS*32 ;positions of each class, 4 each
+DfaSet		equ	Queue		;positions of each DFA state, 4 each
+EolAcc		equ	Queue+MAXSTATE*4 ;1=the state matches at the line end
+RecStk		equ	EolAcc+MAXSTATE	;First, Last, Null of the parts
+RECEND		equ	Queue+MAXNODE*2-8
+WINEND		equ	Buf+2*HALF ;end of the -z window, 32K for deflate
 
 	psect	DATA
 
@@ -57,22 +185,64 @@ CrtDrv: defb      0       	;currently active drive.
 ;
 NamePnt:defw      0       	;input line pointer used for error message. 
 				;Points to start of name in error.
+ArgPnt:	defw	0		;next file mask in Args
 
 NoFile: defm    "No file name match!"
 	defb	0
-TooManyFiles:
-	defm	"Too many files match!"
+TooManyPats:
+	defm	"Too many strings!"
+	defb	0
+BadRegex:
+	defm	"Bad regular expression!"
+	defb	0
+BadData:
+	defm	": bad data!"
 	defb	0
+;
+;	-z: deflate length and distance codes, order of the code length code
+;
+LBase:	defw	3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31
+	defw	35,43,51,59,67,83,99,115,131,163,195,227,258
+LExt:	defb	0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0
+DBase:	defw	1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193
+	defw	257,385,513,769,1025,1537,2049,3073,4097,6145
+	defw	8193,12289,16385,24577
+DExt:	defb	0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11
+	defb	12,12,13,13
+Order:	defb	16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15
+;
 GrepHelp:
-	defm	"Use: grep filename.ext"
-	defb	CR,LF
-	defm	"please enter the string to be searched, followed by a <CR>:"
+	defm	"Use: grep [-n|-c] [-i] [-z] [-f file | [-e] string] filename.ext [filename.ext ...]"
 	defb	CR,LF, CR,LF
 	defm	"Lists the files containing the specified string"
 	defb	CR,LF
+	defm	"( -n lists the matching lines with their numbers,"
+	defb	CR,LF
+	defm	"  -c counts the matching lines of each file )"
+	defb	CR,LF
+	defm	"( -f searches all strings of the file, one per line )"
+	defb	CR,LF
+	defm	"( -i ignores upper and lower case )"
+	defb	CR,LF
+	defm	"( -e: string is a regular expression of . [a-z] [^a-z] * + ? ^ $ | ( ) )"
+	defb	CR,LF
+	defm	"( -z searches the members of .ZIP and .GZ files, not with -f or -e )"
+	defb	CR,LF
+	defm	"( "
+	defb	'"'
+	defm	"quoted string"
+	defb	'"'
+	defm	" may contain blanks, lower case is kept )"
+	defb	CR,LF
+	defm	"( without string on the command line it is asked for )"
+	defb	CR,LF
 	defm	"( ambiguous file references may be used, e.g. *.c or test?.asm )"
 	defb	CR,LF
-	defm	"( up to 512 files can be searched )"
+	defm	"( any number of files can be searched )"
+	defb	CR,LF
+	defm	"( *:name.ext searches all drives, name.ext[U5] user area 5,"
+	defb	CR,LF
+	defm	"  name.ext[U*] all user areas )"
 	defb	0
 EnterString:
 	defm	"please enter the string to be searched, followed by a <CR>:"
@@ -89,15 +259,24 @@ fcbcr:	defb	0		; CR=0
 
 	psect	TEXT
 ;
-;	grep [file.ext] string
+;	grep [string] file.ext [file.ext ...]
 ;
 start:
  	ld	sp,(6)
 	ld	c,25
 	call	BDOS
 	ld	(CrtDrv),a	;current disk
-	ld      de,TBUFF
-        call    SetDMA          ;set standard dma address.
+	ld	e,0FFH		;current user area
+	ld	c,32
+	call	BDOS
+	ld	(OrgUser),a
+	ld	c,12		;BDOS version
+	call	BDOS
+	ld	a,l
+	cp	30h		;CP/M 3 reads all records with one call
+	sbc	a,a		;0FFh if < 3.0
+	inc	a
+	ld	(Multi),a
 	ld	hl,CommLine
 	ld	a,(hl)		;len
 	or	a
@@ -105,26 +284,171 @@ start:
 	inc	hl
 	call	AddHL		;HL=HL+A
 	ld	(hl),0		;place a zero at the end of command line
+	ld	hl,CommLine+1	;TBUFF is needed for the directory search,
+	ld	de,Args		;keep a copy of the command line
+	ld	bc,128
+	ldir
+	xor	a		;options
+	ld	(Opts),a
+	ld	(Arc),a		;Fill reads plain files, e.g. the -f file
+	ld	de,Args
+	ld	hl,Opts
+opt:	call	NonBlank
+	cp	'-'
+	jr	nz,3f
+1:	inc	de
+	ld	a,(de)
+	call	ToUpper
+	cp	'N'
+	jr	nz,2f
+	set	0,(hl)		;OPT_N
+	jr	1b
+2:	cp	'C'
+	jr	nz,6f
+	set	1,(hl)		;OPT_C
+	jr	1b
+6:	cp	'F'
+	jr	nz,8f
+	set	2,(hl)		;OPT_F
+	jr	1b
+8:	cp	'I'
+	jr	nz,9f
+	set	3,(hl)		;OPT_I
+	jr	1b
+9:	cp	'E'
+	jr	nz,7f
+	set	4,(hl)		;OPT_E
+	jr	1b
+7:	cp	'Z'
+	jr	nz,4f
+	set	5,(hl)		;OPT_Z
+	jr	1b
+4:	or	a		;end of the option word?
+	jr	z,opt
+	cp	' '
+	jp	nz,Help		;unknown option
+	jr	opt
+3:	ld	(ArgPnt),de	;string or file names follow
+	ld	a,(hl)		;-z: -f and -e need the window
+	and	OPT_Z
+	jr	z,2f
+	ld	a,(hl)
+	and	OPT_F+OPT_E
+	jp	nz,Help
+2:	bit	1,(hl)		;-c shows no lines
+	jr	z,5f
+	res	0,(hl)
+5:	call	MakeFold	;fold table for -i
+	ld	hl,Opts
+	bit	2,(hl)		;-f: the file name of the strings follows
+	jr	z,7f
+	bit	4,(hl)		;-e needs a string
+	jp	nz,Help
+	call	ReadPatterns
+	ld	a,1		;no string, nothing to keep between fills
+	ld	(len),a
+	jr	nextmask
+7:	call	GetString	;string from command line or console
+	ld	a,(len)
+	or	a
+	jp	z,0		;nothing to search
+	ld	a,(Opts)
+	and	OPT_E
+	jr	z,9f
+	call	ReCompile	;-e: DFA of the expression
+	ld	a,1		;nothing to keep between fills
+	ld	(len),a
+	jr	nextmask
+9:	call	MakeSkip	;skip table for this string
+nextmask:
+	ld	de,(ArgPnt)	;any file name left?
+	call	NonBlank
+	jp	z,0		;no, finis, reboot
+	ld	(ArgPnt),de
+	call	Qualify		;*: and [Uxx]
 	call    ConvFirst       ;convert file name.
-	call	SaveString	;read & save string to be searched
-        call    DriveSel        ;select indicated drive.
         ld      hl,TFCB+1       ;was any file indicated?
         ld      a,(hl)
         cp      ' '
-        jp      nz,search
+        jp      nz,1f
         ld      b,11            ;no. Fill field with '?' - same as *.*.
-1:	ld      (hl),'?'
+2:	ld      (hl),'?'
         inc     hl
         dec     b		
-        jp      nz,1b
-search: 
+        jp      nz,2b
+1:	xor	a
+	ld	(AnyFile),a
+	ld	a,(AllDrv)
+	or	a
+	jr	z,dloop
+	ld	a,1		;*: from A: on
+	ld	(ChgDrv),a
+dloop:	ld	a,(AllDrv)	;drive there?
+	or	a
+	jr	z,1f
+	ld	a,(ChgDrv)
+	dec	a
+	call	DriveOk
+	jr	z,nextdrv
+1:	call    DriveSel        ;select indicated drive.
+	ld	a,(UserLo)
+	ld	(UserCur),a
+uloop:	ld	a,(UserCur)	;select the user area
+	ld	e,a
+	ld	c,32
+	call	BDOS
+	ld	de,TBUFF	;directory search needs the standard dma
+	call	SetDMA
+	call	SearchDir
+	ld	hl,UserCur	;next user area
+	ld	a,(UserHi)
+	cp	(hl)
+	jr	z,nextdrv
+	inc	(hl)
+	jr	uloop
+nextdrv:
+	ld	a,(AllDrv)	;next drive
+	or	a
+	jr	z,1f
+	ld	hl,ChgDrv
+	inc	(hl)
+	ld	a,(hl)
+	cp	17
+	jr	c,dloop
+1:	ld	a,(OrgUser)	;back to the user area
+	ld	e,a
+	ld	c,32
+	call	BDOS
+	ld	a,(AnyFile)	;none found at all?
+	or	a
+	jp	nz,nextmask
+	ld	bc,NoFile
+	call	PrintLine
+	jp	nextmask	;try the next file name
+;
+;	Search the file name in TFCB on the selected drive and user area
+;
+SearchDir:
+	ld	hl,0		;no batch done yet
+	ld	(DirDone),hl
 	call    SearchFCB         ;get first file name.
-        jp      z,None          ;none found at all?
-	ld	hl,0		;init file counter
+	ret	z		;none found
+	ld	a,1
+	ld	(AnyFile),a
+batch:	ld	hl,0		;init file counter
 	ld	(FilesCnt),hl
+	ld	(DirCnt),hl
 	ld	hl,FileNames
 	ld	(FilesPointer),hl	
 loop:
+	ld	hl,(DirCnt)	;count the entries found
+	inc	hl
+	ld	(DirCnt),hl
+	dec	hl
+	ld	de,(DirDone)	;done in a batch before?
+	or	a
+	sbc	hl,de
+	jp	c,skip
 	ld	de,(FilesPointer)
 	ld      a,(RtnCode)     ;get file's position in segment (0-3).
         rrca	
@@ -151,18 +475,29 @@ loop:
 	ld	hl,(FilesCnt)	;increment files counter
 	inc	hl
 	ld	(FilesCnt),hl
-	ld	bc,MAX_FILES_CNT+1
+	ld	bc,BATCH
 	sbc	hl,bc
-	jp	z,toomany
+	jr	z,full
 skip:   call    SearchNext         ;get next file name.
-	jp	z,SearchString	;if no more, go search the string
-        jp      loop            ;else continue with our list.
+	jp	nz,loop		;continue with our list.
+	ld	hl,(FilesCnt)	;only system files?
+	ld	a,l
+	or	h
+	ret	z
+	jp	SearchString	;no, go search the string
 ;
-;	Too many files
+;	Batch full: search it, then search the directory again from the
+;	start and skip the entries done. The file i/o in between loses the
+;	place of SearchNext.
 ;
-toomany:ld      bc,TooManyFiles
-        call    PrintLine
-	jp	0		;reboot
+full:	ld	hl,(DirCnt)
+	ld	(DirDone),hl
+	call	SearchString
+	ld	de,TBUFF
+	call	SetDMA
+	call	SearchFCB
+	jp	nz,batch
+	ret
 ;
 ;	Display help
 ;
@@ -170,6 +505,59 @@ Help:	ld	bc,GrepHelp
 	call	PrintLine
 	jp	0
 ;
+;	Get the string from the command line: a "quoted string" or the
+;	first word, if a file name follows; else read it from the console
+;
+GetString:
+	ld	de,(ArgPnt)
+	call	NonBlank
+	ld	(ArgPnt),de	;file names start here if no string given
+	cp	'"'
+	jr	z,quoted
+	ld	h,d		;HL=first word
+	ld	l,e
+	call	WordEnd		;DE=end of the first word
+	call	NonBlank
+	jr	z,SaveString	;only one word: file name, ask for the string
+	ld	c,' '		;ends with a blank
+	jr	copystr
+quoted:	ld	h,d		;skip the "
+	ld	l,e
+	inc	hl
+	ld	c,'"'		;ends with a "
+copystr:
+	ld	de,String
+	ld	b,0		;length
+1:	ld	a,(hl)
+	or	a
+	jr	z,2f
+	inc	hl
+	cp	c		;end of string?
+	jr	z,2f
+	ld	(de),a
+	inc	de
+	inc	b
+	ld	a,b
+	cp	127
+	jr	c,1b
+2:	xor	a
+	ld	(de),a		;set final zero
+	ld	a,b
+	ld	(len),a
+	ld	(ArgPnt),hl	;file names follow
+	ret
+;
+;	DE = pointer to the first char after the word at DE (blank or zero)
+;
+WordEnd:
+	ld	a,(de)
+	or	a
+	ret	z
+	cp	' '
+	ret	z
+	inc	de
+	jr	WordEnd
+;
 ;	Read the String
 ;
 SaveString:
@@ -202,60 +590,393 @@ sloop:
 	ld	bc,11
 	ldir
 	ld	(FilesPointer),hl;update files pointer
-	xor	a		
-	ld	(Eof),a		;init Eof mark
-	ld	a,EOF
-	ld	(Buf2+128),a	;store EOF mark after Buf2
-	xor	a		;prepare fcb
-	ld	(fcbcr),a
+	ld	hl,name+11	;prepare fcb: clear EX .. R2, a file
+	ld	b,24		; > 16K leaves EX and S2 set
+1:	ld	(hl),0
+	inc	hl
+	djnz	1b
 	ld	de,fcb
 	call	Open		;open file
-	ld	de,Buf1		;read in Buf1
-	call	SetDMA
-	ld	de,fcb
-	call	ReadRec	
-	jr	nz,closeit	;file empty?
+	inc	a		;0FFh: not found, skip it
+	jp	z,nextfile
+	call	ArcOpen		;-z: first member of an archive
+	jr	nz,member
+	ld	a,(Arc)
+	or	a
+	jp	nz,closeit	;archive without members to search
+member:
+	xor	a
+	ld	(Eof),a		;init Eof mark
+	ld	(Pending),a
+	ld	l,a
+	ld	h,a
+	ld	(Hits),hl
+	ld	(Found),hl	;no string of -f found yet
+	ld	(Found+2),hl
+	inc	hl
+	ld	(LineNo),hl
+	ld	hl,Nodes
+	ld	(AcState),hl
+	call	ReReset
+	ld	hl,Buf		;first fill: nothing to keep
+	ld	(LineStart),hl
+	ld	(Counted),hl
+	ld	(BufStart),hl
+	ld	(NextBuf),hl
 readloop:
-	ld	de,Buf2		;read in Buf2
-	call	SetDMA
-	ld	de,fcb
-	call	ReadRec
-	ld	(Eof),a		;save Eof mark
-	ld	hl,Buf1
+	push	hl		;search starts here
+	call	Fill		;read the next NREC records
+	pop	hl
+	ld	a,(Pending)	;a matching line goes on?
+	or	a
+	jr	z,scanbuf
+	ld	hl,(BufStart)	;yes, show the rest of it
+	call	ShowLine
+scanbuf:
 	call	FindString
-	jr	nc,found
-				;string not found
+	jr	c,nomatch
+	ld	a,(Opts)
+	and	OPT_N+OPT_C+OPT_F
+	jp	z,found		;only the file name
+	cp	OPT_F
+	jr	nz,1f
+	inc	hl		;-f: find all strings of the file
+	jr	scanbuf
+1:	call	MatchLine	;count or show the line,
+	jr	scanbuf		; then search behind it
+nomatch:			;string not found
 	ld	a,(Eof)
 	or	a		;if EOF
-	jr	nz,closeit	; skip to next file
-				;else move Buf2 to Buf1
-	ld	de,Buf1
-	ld	hl,Buf2
+	jr	nz,endfile	; skip to next file
+	ld	bc,0		;bytes of the line to keep
+	ld	a,(Opts)
+	and	OPT_N+OPT_C
+	jr	z,1f
+	ld	de,(BufEnd)	;count the lines up to the end
+	call	CountLines
+	ld	hl,(BufEnd)
+	ld	de,(LineStart)
+	or	a
+	sbc	hl,de		;HL=length of the current line
 	ld	bc,128
+	sbc	hl,bc
+	add	hl,bc
+	jr	nc,2f		;longer: keep only its end
+	ld	b,h
+	ld	c,l
+2:	ld	hl,(NextBuf)	;the line starts in front of the next
+	or	a		; fill now
+	sbc	hl,bc
+	ld	(LineStart),hl
+	ld	hl,(NextBuf)
+	ld	(Counted),hl
+1:	ld	a,(len)		;keep at least the last len-1 bytes
+	dec	a		; in front of it, a match may start there
+	cp	c
+	jr	c,3f
+	ld	c,a
+3:	ld	hl,(NextBuf)	;-z: the next half of the window
+	or	a		; may follow, then they stay there
+	sbc	hl,bc
+	ex	de,hl		;DE=NextBuf-kept bytes
+	ld	hl,(BufEnd)
+	sbc	hl,bc		;CARRY=0 here
+	ld	a,c
+	or	a
+	jr	z,4f		;one char string: nothing to keep
 	ldir
-	jr	readloop	;then read in Buf2
-found:				;match found, type the file name & ext
+4:	ld	a,(len)		;next search starts len-1 bytes in front
+	dec	a
+	ld	c,a
+	ld	hl,(NextBuf)
+	sbc	hl,bc		;CARRY=0 here
+	jp	readloop	;then fill Buf again
+endfile:
+	ld	a,(Opts)
+	and	OPT_N+OPT_C+OPT_F
+	cp	OPT_F		;-f: type the strings found
+	jr	nz,1f
+	call	ShowFound
+	jr	endmember
+1:	and	OPT_N+OPT_C	;-c: type name and count
+	cp	OPT_C
+	jr	nz,endmember
+	ld	hl,(Hits)
+	ld	a,h
+	or	l
+	jr	z,endmember
+	push	hl
 	call	CrLf
-	ld	hl,name		;first name
-	ld	b,8
-	call	PrintToSpace
-	ld	a,'.'		;.
+	call	PrintName
+	ld	a,':'
 	call	Print
-	ld	hl,name+8	;then ext
-	ld	b,3
-	call	PrintToSpace
+	pop	hl
+	call	PrintDec
+	jr	endmember
+found:				;match found, type the file name & ext
+	call	CrLf
+	call	PrintName
+endmember:
+	ld	a,(Arc)		;-z: next member of the archive
+	or	a
+	jr	z,closeit
+	call	NextMember
+	jp	nz,member
 closeit:
 	ld	de, fcb
 	call	Close
-				;decrement files counter
+nextfile:			;decrement files counter
 	ld	hl,(FilesCnt)
 	dec	hl
 	ld	(FilesCnt),hl
 	ld	a,l
 	or	h
 	jp	nz,sloop
-	jp	0		;finis, reboot
+				;all files of this name done
+;
+;	Back to single record reads after Fill
+;
+SingleRec:
+	ld	a,(Multi)
+	or	a
+	ret	z
+	ld	e,1
+	ld	c,44
+	jp	BDOS
+;
+;	Matching line found, HL = last char of the match: count the lines
+;	up to here, show the line with -n, return HL behind the line
+;
+MatchLine:
+	ex	de,hl
+	call	CountLines
+	ld	hl,(Hits)
+	inc	hl
+	ld	(Hits),hl
+	ld	a,(Opts)
+	and	OPT_N+OPT_C
+	cp	OPT_N
+	jr	nz,1f
+	call	CrLf		;name:number:line
+	call	PrintName
+	ld	a,':'
+	call	Print
+	ld	hl,(LineNo)
+	call	PrintDec
+	ld	a,':'
+	call	Print
+1:	ld	hl,(LineStart)
+;
+;	Go to the end of the line at HL, type it with -n
+;	returns HL behind the LF, Pending=1 if the buffer ends before
+;
+ShowLine:
+	ld	de,(BufEnd)
+1:	ld	a,l
+	cp	e
+	jr	nz,2f
+	ld	a,h
+	cp	d
+	ld	a,1
+	jr	z,3f		;end of buffer, the line goes on
+2:	ld	a,(hl)
+	inc	hl
+	cp	LF
+	jr	nz,4f
+	ld	de,Nodes	;end of line, -f and -e start again
+	ld	(AcState),de
+	push	hl
+	call	ReReset
+	pop	hl
+	xor	a
+3:	ld	(Pending),a
+	ret
+4:	cp	CR
+	jr	z,1b
+	cp	EOF
+	jr	z,1b
+	ld	c,a
+	ld	a,(Opts)
+	and	OPT_N+OPT_C
+	cp	OPT_N
+	jr	nz,1b
+	ld	a,c
+	push	de
+	push	hl
+	call	Print
+	pop	hl
+	pop	de
+	jr	1b
+;
+;	Count the LFs from Counted up to DE
+;	sets LineNo and LineStart behind the last LF
+;
+CountLines:
+	ld	hl,(Counted)
+	ex	de,hl
+	ld	(Counted),hl
+	or	a
+	sbc	hl,de
+	ld	b,h		;BC=bytes to count
+	ld	c,l
+	ex	de,hl		;HL=start
+1:	ld	a,b
+	or	c
+	ret	z
+	ld	a,LF
+	cpir
+	ret	nz		;no more LF
+	ld	(LineStart),hl
+	push	hl
+	ld	hl,(LineNo)
+	inc	hl
+	ld	(LineNo),hl
+	pop	hl
+	jr	1b
+;
+;	Fill Buf with up to NREC records of the file
+;	sets BufEnd and sets Eof at end of file
+;	with -n or -c the data ends at a ^Z in the last record
+;
+Fill:
+	ld	a,(Arc)		;-z: inflate into the window
+	or	a
+	jp	nz,ZFill
+	ld	de,Buf
+	ld	a,(Multi)
+	or	a
+	jr	z,2f
+	call	SetDMA		;CP/M 3: all records with one read
+	ld	e,NREC
+	ld	c,44		;set multi-sector count
+	call	BDOS
+	ld	de,fcb
+	call	ReadRec
+	ld	b,NREC		;all records read
+	jr	z,4f
+	ld	b,h		;H=records read before the end of file
+	jr	3f
+2:	ld	b,0		;CP/M 2: record by record
+1:	push	bc
+	push	de
+	call	SetDMA
+	ld	de,fcb
+	call	ReadRec
+	pop	hl
+	pop	bc
+	jr	nz,3f		;end of file
+	ld	de,128		;next record
+	add	hl,de
+	ex	de,hl
+	inc	b
+	ld	a,b
+	cp	NREC
+	jr	c,1b
+	jr	4f
+3:	ld	a,1
+	ld	(Eof),a
+4:	ld	h,b		;HL=Buf+B*128
+	ld	l,0
+	srl	h
+	rr	l
+	ld	de,Buf
+	add	hl,de
+	ld	(BufEnd),hl
+	ld	a,(Eof)		;lines of a text file end at the
+	or	a		; first ^Z of its last record
+	ret	z
+	ld	a,(Opts)
+	and	OPT_N+OPT_C+OPT_F+OPT_E
+	ret	z
+	inc	b
+	dec	b
+	ret	z		;no last record
+	ld	de,-128
+	add	hl,de
+	ld	bc,128
+;
+;	End the data at the first ^Z of the last record at HL, BC long
+;
+TrimEof:
+	ld	a,EOF
+	cpir
+	ret	nz
+	dec	hl
+	ld	(BufEnd),hl
+	ret
 
+;	type the file name & ext, with the drive if one was given
+;
+PrintName:
+	ld	a,(UserGiven)	;user area given?
+	or	a
+	jr	nz,2f
+	ld	a,(ChgDrv)	;drive given?
+	or	a
+	jr	z,1f
+2:	call	GetDisk		;yes, type it, too
+	add	a,'A'
+	call	Print
+	ld	a,(UserGiven)	;and the user area
+	or	a
+	jr	z,3f
+	ld	a,(UserCur)
+	ld	l,a
+	ld	h,0
+	call	PrintDec
+3:	ld	a,':'
+	call	Print
+1:	ld	hl,name		;first name
+	ld	b,8
+	call	PrintToSpace
+	ld	a,'.'		;.
+	call	Print
+	ld	hl,name+8	;then ext
+	ld	b,3
+	call	PrintToSpace
+	ld	a,(Arc)		;-z: then the member
+	or	a
+	ret	z
+	ld	a,(MemName)
+	or	a
+	ret	z		;gzip without name
+	ld	a,':'
+	call	Print
+	ld	hl,MemName
+	jp	PrintStr
+;
+;	print HL as decimal number without leading zeros
+;
+PrintDec:
+	ld	b,0		;no digit yet
+	ld	de,-10000
+	call	1f
+	ld	de,-1000
+	call	1f
+	ld	de,-100
+	call	1f
+	ld	de,-10
+	call	1f
+	ld	b,1		;last digit always
+	ld	de,-1
+1:	ld	a,'0'-1
+2:	inc	a
+	add	hl,de
+	jr	c,2b
+	sbc	hl,de		;one step back, CARRY=0 here
+	cp	'0'
+	jr	nz,3f
+	inc	b
+	dec	b
+	ret	z		;leading zero
+3:	ld	b,1
+	push	bc
+	push	hl
+	call	Print
+	pop	hl
+	pop	bc
+	ret
+;
 ;	print B chars from HL but stops at a blank
 ;
 PrintToSpace:
@@ -504,7 +1225,7 @@ ConvFirst:
         push    hl		;push fcb
         xor     a
         ld      (ChgDrv),a      ;initialize drive change flag.
-        ld      hl,CommLine+1   ;set (hl) as pointer into input line.
+        ld      hl,(ArgPnt)     ;set (hl) as pointer into input line.
         ex      de,hl
         call    NonBlank        ;get next non-blank character.
         ex      de,hl
@@ -586,7 +1307,8 @@ GetExt: ld      b,03H
         ld      (hl),' '
         dec     b
         jp      nz,5b
-6:	ld      b,3
+6:	ld	(ArgPnt),de	;next file name starts here
+	ld      b,3
 7:	inc     hl
         ld      (hl),0
         dec     b
@@ -617,46 +1339,2685 @@ DriveSel:
         ld      (TFCB),a
         ld      a,(ChgDrv)      ;a drive change indicated?
         or      a
-        ret     z
-        dec     a               ;yes, is it the same as the current drive?
-        ld      hl,CrtDrv
-        cp      (hl)
-        ret     z
-        jp      DiskSel          ;no. Select it then.
+        jr	nz,1f
+	ld	a,(CrtDrv)	;no, back to the current drive,
+	inc	a		;an earlier file name may have changed it
+1:	dec     a
+        jp      DiskSel		;select it
+;
+;	Drive A (0..15) there? Z if not. A missing drive must not be
+;	selected by the BDOS: under CP/M 3 the select error is returned
+;	(BDOS 45), under CP/M 2.2 the BIOS SELDSK is asked and the BDOS
+;	drive is selected in the BIOS again.
+;
+DriveOk:
+	ld	c,a
+	ld	a,(Multi)
+	or	a
+	jr	z,1f
+	push	bc		;CP/M 3
+	ld	e,0FFH		;return errors
+	ld	c,45
+	call	BDOS
+	pop	de
+	ld	c,14
+	call	BDOS
+	push	af
+	ld	e,0		;back to the default error mode
+	ld	c,45
+	call	BDOS
+	pop	af
+	inc	a		;0FFh: no such drive
+	ret
+1:	ld	e,0		;CP/M 2.2
+	call	SelDsk		;HL=DPH, 0 if no such drive
+	ld	a,h
+	or	l
+	push	af
+	call	GetDisk
+	ld	c,a
+	ld	e,1		;logged in
+	call	SelDsk
+	pop	af
+	ret
+;
+;	BIOS SELDSK, C = drive, E = 0 for the first select
+;
+SelDsk:	ld	hl,(1)		;WBOOT
+	push	de
+	ld	de,24
+	add	hl,de
+	pop	de
+	jp	(hl)
+;
+;	Take *: and [Unn] or [U*] out of the file name at DE
+;	*: is changed to A:, the user area qualifier to blanks
+;
+Qualify:
+	ld	(NamePnt),de	;for SyntaxErr
+	xor	a
+	ld	(AllDrv),a
+	ld	(UserGiven),a
+	ld	a,(OrgUser)
+	ld	(UserLo),a
+	ld	(UserHi),a
+	ld	a,(de)
+	cp	'*'
+	jr	nz,1f
+	inc	de
+	ld	a,(de)
+	dec	de
+	cp	':'
+	jr	nz,1f
+	ld	a,'A'		;parse it as A:
+	ld	(de),a
+	ld	(AllDrv),a
+1:	ld	a,(de)		;[ in this name?
+	or	a
+	ret	z
+	cp	' '
+	ret	z
+	cp	'['
+	jr	z,2f
+	inc	de
+	jr	1b
+2:	ld	h,d		;HL=[
+	ld	l,e
+	inc	de
+	ld	a,(de)
+	call	ToUpper
+	cp	'U'
+	jp	nz,SyntaxErr
+	inc	de
+	ld	a,(de)
+	cp	'*'
+	jr	nz,3f
+	xor	a		;all user areas
+	ld	(UserLo),a
+	ld	a,15
+	ld	(UserHi),a
+	inc	de
+	jr	5f
+3:	ld	b,0		;user number
+4:	ld	a,(de)
+	sub	'0'
+	cp	10
+	jr	nc,6f
+	ld	c,a
+	ld	a,b
+	add	a,a
+	add	a,a
+	add	a,b
+	add	a,a
+	add	a,c
+	ld	b,a
+	inc	de
+	jr	4b
+6:	ld	a,b
+	cp	16
+	jp	nc,SyntaxErr
+	ld	(UserLo),a
+	ld	(UserHi),a
+5:	ld	a,(de)
+	cp	']'
+	jp	nz,SyntaxErr
+	inc	de
+	ld	a,1
+	ld	(UserGiven),a
+7:	ld	(hl),' '	;blank it out
+	inc	hl
+	ld	a,l
+	cp	e
+	jr	nz,7b
+	ret
 ;
-;   Required file(s) not located.
+;	MakeFold
+;
+;	builds the fold table, each char to itself, with -i lower case
+;	letters to upper case. It lies in the page behind the skip table.
+;
+MakeFold:
+	ld	hl,SkipBuf+255	;page aligned tables
+	ld	a,h
+	ld	(SkipPage),a
+	inc	h
+	ld	a,h
+	ld	(FoldPage),a
+	ld	l,0
+1:	ld	(hl),l
+	inc	l
+	jr	nz,1b
+	ld	a,(Opts)
+	and	OPT_I
+	ret	z
+	ld	l,'a'
+2:	ld	a,l
+	and	5FH
+	ld	(hl),a
+	inc	l
+	ld	a,l
+	cp	'z'+1
+	jr	nz,2b
+	ret
+;
+;	Fold the char A, no other register affected
+;
+FoldA:
+	push	hl
+	ld	l,a
+	ld	a,(FoldPage)
+	ld	h,a
+	ld	a,(hl)
+	pop	hl
+	ret
+;
+;	MakeSkip
 ;
-None:   ld      bc,NoFile
-        call    PrintLine
-	jp	0		;reboot
+;	folds the string and builds the skip table of FindString for strings
+;	of 3 and more chars, with -i for all: each char is skipped by its
+;	distance from the end of the string, chars not in the string by the
+;	string length. The last char of the string gets 0, it marks a
+;	possible match, its own skip is LastSkip. With -i each char gets
+;	the skip of its folded char.
+;
+MakeSkip:
+	ld	hl,String	;fold the string
+	ld	a,(len)
+	ld	b,a
+1:	ld	a,(hl)
+	call	FoldA
+	ld	(hl),a
+	inc	hl
+	djnz	1b
+	ld	a,(Opts)
+	and	OPT_I
+	ld	a,(len)
+	jr	nz,2f		;-i: all strings use it
+	cp	3
+	ret	c		;short strings don't use it
+2:	ld	c,a
+	ld	a,(SkipPage)
+	ld	h,a
+	ld	l,0
+	ld	a,c
+	ld	b,0		;256 entries
+3:	ld	(hl),a
+	inc	hl
+	djnz	3b
+	dec	h		;back to the table
+	ld	de,String
+	dec	a
+	jr	z,5f		;one char string
+	ld	b,a		;len-1 chars, B=distance from the end
+4:	ld	a,(de)
+	ld	l,a
+	ld	(hl),b
+	inc	de
+	djnz	4b
+5:	ld	a,(de)		;last char of the string
+	ld	l,a
+	ld	a,(hl)
+	ld	(LastSkip),a
+	ld	(hl),0
+	dec	de
+	ld	(StrLast),de
+	ld	a,(Opts)
+	and	OPT_I
+	ret	z
+	ld	a,(FoldPage)	;-i: the skip of the folded char
+	ld	d,a
+	ld	e,0
+6:	ld	a,(de)
+	ld	l,a
+	ld	a,(hl)
+	ld	l,e
+	ld	(hl),a
+	inc	e
+	jr	nz,6b
+	ret
 ;
 ;	FindString
 ;
 ;	HL = pointer to buffer
-;		(buffer ends with 1AH)
-;	String = address of the string to be found
-;		(string ends with 0)
+;		(BufEnd = end of the data)
+;	String = address of the string to be found, len = its length
 ;
 ;	returns CARRY = 1 if end-of-buffer reached
-;			0 if match found
+;			0 if match found, HL = last char of the match
 ;
-;	registers affected: HL, BC, E, A
+;	Horspool search: the buffer char under the end of the string
+;	tells how far the string can move on. 1 and 2 char strings
+;	use cpir instead if case matters, the strings of -f use FindMulti.
+;	The chars compared are folded with the fold table.
+;
+;	registers affected: HL, BC, DE, A
 ;
 FindString:
-	ld	bc,String	;BC=string pointer
-next:
-	ld	a,(bc)
-	or	a		;if end of string reached,
-	ret	z		;return CARRY=0
-	ld	e,a		;E=byte from string
-	ld	a,(hl)		;A=byte from buffer
-	cp	EOF
-	scf			;if end of buffer reached,
-	ret	z		;return CARRY=1
-	inc	hl		;increment pointer in buffer
-	cp	e		;byte from string ? byte from buffer
-	jr	nz,FindString	;no, try next byte from buffer
-	inc	bc		;yes, increment pointer in string
-	jr	next		;and go compare the next chars
+	ld	a,(Opts)
+	and	OPT_F
+	jp	nz,FindMulti
+	ld	a,(Opts)
+	and	OPT_E
+	jp	nz,FindRegex
+	ld	a,(len)
+	or	a
+	ret	z		;empty string is found at once
+	ld	c,a
+	ld	a,(Opts)
+	and	OPT_I
+	ld	a,c
+	jr	nz,horsp	;-i: no cpir
+	cp	3
+	jr	c,FindShort
+horsp:	dec	a
+	ld	e,a
+	ld	d,0
+	add	hl,de		;HL=end of the first window
+	ld	bc,(BufEnd)
+	ld	a,(SkipPage)
+	ld	d,a		;DE=table entry
+	jr	2f
+1:	ld	e,(hl)		;char under the end of the string
+	ld	a,(de)		;how far to move on
+	or	a
+	jr	z,check		;may be a match
+3:	add	a,l
+	ld	l,a
+	jr	nc,2f
+	inc	h
+2:	ld	a,l		;still in the buffer?
+	sub	c
+	ld	a,h
+	sbc	a,b
+	jr	c,1b
+	scf			;end of buffer
+	ret
+check:				;compare the rest backwards
+	push	bc
+	push	de
+	push	hl
+	ld	de,(StrLast)
+	ld	a,(len)
+	dec	a
+	jr	z,6f		;one char string
+	ld	b,a
+	ld	a,(FoldPage)
+	ld	c,a
+4:	dec	hl
+	push	hl
+	ld	l,(hl)		;fold the buffer char
+	ld	h,c
+	ld	a,(de)
+	cp	(hl)
+	pop	hl
+	jr	nz,5f
+	dec	de
+	djnz	4b
+6:	pop	hl		;match found
+	pop	de
+	pop	bc
+	or	a		;CARRY=0
+	ret
+5:	pop	hl
+	pop	de
+	pop	bc
+	ld	a,(LastSkip)
+	jr	3b
+;
+;	1 or 2 chars: cpir for the first char
+;
+FindShort:
+	ex	de,hl
+	ld	hl,(BufEnd)
+	or	a
+	sbc	hl,de
+	ld	b,h		;BC=bytes in the buffer
+	ld	c,l
+	ex	de,hl
+1:	ld	a,b
+	or	c
+	scf
+	ret	z		;end of buffer
+	ld	a,(String)
+	cpir
+	scf
+	ret	nz		;first char not found
+	ld	a,(len)
+	cp	2
+	ccf
+	ret	nc		;one char string found
+	ld	a,b		;second char still in the buffer?
+	or	c
+	scf
+	ret	z
+	ld	a,(String+1)
+	cp	(hl)
+	jr	nz,1b
+	or	a		;CARRY=0, found
+	ret
+;
+;
+;	ReadPatterns
+;
+;	reads the -f file named at ArgPnt, one string per line, and builds
+;	the Aho-Corasick automaton of the strings: a trie of all strings,
+;	the fail link of a node goes to the node of the longest suffix of
+;	its path that is in the trie, too. So each file is read only once
+;	for all strings.
+;
+ReadPatterns:
+	call	ConvFirst	;file name to TFCB
+	ld	hl,TFCB+1
+	ld	a,(hl)
+	cp	' '
+	jp	z,Help		;no file name
+	ld	de,name
+	ld	bc,11
+	ldir
+	ld	a,(ChgDrv)	;0=current drive
+	ld	(fcb),a
+	ld	hl,name+11	;clear EX .. R2
+	ld	b,24
+1:	ld	(hl),0
+	inc	hl
+	djnz	1b
+	ld	de,fcb
+	call	Open
+	inc	a
+	jr	nz,2f
+	ld	bc,NoFile
+	call	PrintLine
+	jp	0
+2:	xor	a
+	ld	(PatCnt),a
+	ld	(Eof),a
+	ld	hl,PatText
+	ld	(PatPtr),hl
+	ld	(PatStart),hl
+	ld	hl,Nodes	;the root
+	ld	b,NODE
+3:	ld	(hl),0
+	inc	hl
+	djnz	3b
+	ld	(NodePtr),hl
+4:	call	Fill		;next part of the file
+	ld	hl,Buf
+5:	ld	de,(BufEnd)	;end of this part?
+	or	a
+	sbc	hl,de
+	add	hl,de
+	jr	nz,6f
+	ld	a,(Eof)
+	or	a
+	jr	z,4b
+	jr	8f
+6:	ld	a,(hl)
+	inc	hl
+	cp	EOF
+	jr	z,8f
+	cp	CR
+	jr	z,5b
+	cp	LF
+	jr	nz,7f
+	call	EndPat		;end of line
+	jr	5b
+7:	ex	de,hl
+	ld	hl,(PatPtr)	;store the char
+	ld	(hl),a
+	inc	hl
+	ld	(PatPtr),hl
+	ld	bc,PatText+PATSIZE-1
+	or	a		;room left for the zero?
+	sbc	hl,bc
+	ex	de,hl
+	jr	c,5b
+	jr	PatErr
+8:	call	EndPat		;last line
+	ld	de,fcb
+	call	Close
+	call	SingleRec
+	jp	MakeFail
+;
+;	Too many strings in the -f file
+;
+PatErr:	call	SingleRec
+	ld	bc,TooManyPats
+	call	PrintLine
+	jp	0
+;
+;	End of a line of the -f file: add its string to the trie
+;
+EndPat:
+	push	hl
+	ld	hl,(PatPtr)
+	ld	de,(PatStart)
+	or	a
+	sbc	hl,de
+	add	hl,de
+	jr	z,1f		;empty line
+	ld	(hl),0
+	inc	hl
+	ld	(PatPtr),hl
+	ld	(PatStart),hl
+	ld	a,(PatCnt)
+	cp	MAXPAT
+	jr	z,PatErr
+	inc	a
+	ld	(PatCnt),a
+	ld	b,a
+	call	Insert
+1:	pop	hl
+	ret
+;
+;	Add the string at DE with number B to the trie
+;
+Insert:
+	ld	ix,Nodes	;IX=root
+1:	ld	a,(de)
+	or	a
+	jr	z,3f
+	inc	de
+	call	FoldA
+	ld	c,a
+	push	ix
+	pop	hl
+	call	Child
+	call	z,NewNode	;not yet in the trie
+	push	hl
+	pop	ix
+	jr	1b
+3:	ld	a,(ix+1)
+	or	a
+	ret	nz		;same string twice
+	ld	(ix+1),b
+	ret
+;
+;	New first child with char C of the node IX, returns HL = the child
+;
+NewNode:
+	push	de
+	ld	hl,(NodePtr)
+	ld	de,Nodes+MAXNODE*NODE
+	or	a
+	sbc	hl,de
+	add	hl,de
+	pop	de
+	jr	nc,PatErr	;no node left
+	push	hl
+	ld	(hl),c		;char
+	inc	hl
+	ld	(hl),0		;no string ends here
+	inc	hl
+	ld	(hl),0		;no child
+	inc	hl
+	ld	(hl),0
+	inc	hl
+	ld	a,(ix+2)	;next sibling = the old first child
+	ld	(hl),a
+	inc	hl
+	ld	a,(ix+3)
+	ld	(hl),a
+	inc	hl
+	xor	a		;fail and dict link
+	ld	(hl),a
+	inc	hl
+	ld	(hl),a
+	inc	hl
+	ld	(hl),a
+	inc	hl
+	ld	(hl),a
+	inc	hl
+	ld	(NodePtr),hl
+	pop	hl
+	ld	(ix+2),l
+	ld	(ix+3),h
+	ret
+;
+;	Child
+;
+;	HL = node, C = char
+;	returns HL = child of the node with this char, Z if there is none
+;
+;	registers affected: HL, A
+;
+Child:
+	inc	hl
+	inc	hl
+	ld	a,(hl)		;first child
+	inc	hl
+	ld	h,(hl)
+	ld	l,a
+1:	ld	a,h
+	or	l
+	ret	z
+	ld	a,(hl)
+	cp	c
+	jr	z,2f
+	inc	hl		;next sibling
+	inc	hl
+	inc	hl
+	inc	hl
+	ld	a,(hl)
+	inc	hl
+	ld	h,(hl)
+	ld	l,a
+	jr	1b
+2:	or	1		;NZ, found
+	ret
+;
+;	Set the fail and dict links, the trie is walked breadth first
+;	so the fail node of each node is done before the node itself
+;
+MakeFail:
+	ld	hl,Nodes	;the root first
+	ld	(Queue),hl
+	ld	hl,Queue
+	ld	(QHead),hl
+	inc	hl
+	inc	hl
+	ld	(QTail),hl
+1:	ld	hl,(QHead)	;queue empty?
+	ld	de,(QTail)
+	or	a
+	sbc	hl,de
+	ret	z
+	add	hl,de
+	ld	e,(hl)		;next node r
+	inc	hl
+	ld	d,(hl)
+	inc	hl
+	ld	(QHead),hl
+	push	de
+	pop	ix		;IX=r
+	ld	l,(ix+2)	;its first child
+	ld	h,(ix+3)
+2:	ld	a,h		;next child u
+	or	l
+	jr	z,1b
+	push	hl
+	pop	iy		;IY=u
+	ex	de,hl
+	ld	hl,(QTail)	;u to the queue
+	ld	(hl),e
+	inc	hl
+	ld	(hl),d
+	inc	hl
+	ld	(QTail),hl
+	ld	c,(iy+0)	;C=char of u
+	ld	l,(ix+6)	;f = fail link of r
+	ld	h,(ix+7)
+3:	ld	a,h
+	or	l
+	jr	z,4f		;none: u fails to the root
+	ld	d,h
+	ld	e,l
+	call	Child		;f has a child with this char?
+	jr	nz,5f		;yes, u fails to it
+	ld	hl,6		;no, try the fail link of f
+	add	hl,de
+	ld	a,(hl)
+	inc	hl
+	ld	h,(hl)
+	ld	l,a
+	jr	3b
+4:	ld	hl,Nodes
+5:	ld	(iy+6),l	;fail link of u
+	ld	(iy+7),h
+	inc	hl
+	ld	a,(hl)		;a string ends at the fail node?
+	dec	hl
+	or	a
+	jr	nz,6f		;yes, it is the dict link
+	ld	de,8		;no, take its dict link
+	add	hl,de
+	ld	a,(hl)
+	inc	hl
+	ld	h,(hl)
+	ld	l,a
+6:	ld	(iy+8),l	;dict link of u
+	ld	(iy+9),h
+	ld	l,(iy+4)	;next sibling
+	ld	h,(iy+5)
+	jr	2b
+;
+;	FindMulti
+;
+;	HL = pointer to buffer
+;		(BufEnd = end of the data)
+;	AcState = node of the automaton, kept from one call to the next
+;
+;	returns CARRY = 1 if end-of-buffer reached
+;			0 if a string of -f found, HL = its last char,
+;			  the bits of all strings ending here set in Found
+;
+;	one step per char, on a mismatch the fail links are followed
+;
+;	registers affected: HL, BC, DE, A
+;
+FindMulti:
+	ld	de,(AcState)	;DE=node
+	jr	4f
+1:	push	hl
+	ld	l,(hl)		;C=next char, folded
+	ld	a,(FoldPage)
+	ld	h,a
+	ld	c,(hl)
+2:	ld	h,d
+	ld	l,e
+	call	Child
+	jr	nz,3f		;go on to the child
+	ld	hl,6		;else follow the fail link
+	add	hl,de
+	ld	a,(hl)
+	inc	hl
+	ld	h,(hl)
+	ld	l,a
+	or	h
+	jr	z,5f		;root: stay there
+	ex	de,hl
+	jr	2b
+3:	ex	de,hl		;DE=the child
+	ld	hl,1
+	add	hl,de
+	ld	a,(hl)		;a string ends here
+	ld	hl,8
+	add	hl,de
+	or	(hl)		;or on the fail links?
+	inc	hl
+	or	(hl)
+	jr	nz,6f
+5:	pop	hl
+	inc	hl
+4:	push	de		;still in the buffer?
+	ld	de,(BufEnd)
+	ld	a,l
+	sub	e
+	ld	a,h
+	sbc	a,d
+	pop	de
+	jr	c,1b
+	ld	(AcState),de
+	scf			;end of buffer
+	ret
+6:	pop	hl		;HL=last char of the match
+	ld	(AcState),de
+	push	hl
+	call	MarkFound
+	pop	hl
+	or	a		;CARRY=0
+	ret
+;
+;	Set the bits in Found of all strings ending at node DE
+;
+MarkFound:
+	ld	h,d
+	ld	l,e
+	inc	hl
+	ld	a,(hl)		;string ending here
+	or	a
+	jr	z,1f
+	dec	a
+	call	FoundBit
+	or	(hl)
+	ld	(hl),a
+1:	ld	hl,8		;dict link
+	add	hl,de
+	ld	e,(hl)
+	inc	hl
+	ld	d,(hl)
+	ld	a,d
+	or	e
+	jr	nz,MarkFound
+	ret
+;
+;	A = string number - 1
+;	returns HL = its byte in Found, A = its bit
+;
+FoundBit:
+	ld	hl,Found
+;
+;	A = bit number, HL = bit set
+;	returns HL = its byte, A = its bit, only C affected
+;
+BitAddr:
+	ld	c,a
+	rrca
+	rrca
+	rrca
+	and	1FH
+	call	AddHL
+	ld	a,c
+	and	7
+	ld	c,a
+	inc	c
+	ld	a,80H
+1:	rlca
+	dec	c
+	jr	nz,1b
+	ret
+;
+;	Type NAME.EXT:string for each string of -f found in the file
+;
+ShowFound:
+	ld	hl,PatText
+	ld	b,0		;string number - 1
+1:	ld	a,(PatCnt)
+	cp	b
+	ret	z
+	push	hl
+	push	bc
+	ld	a,b
+	call	FoundBit
+	and	(hl)
+	jr	z,2f
+	call	CrLf
+	call	PrintName
+	ld	a,':'
+	call	Print
+	pop	bc
+	pop	hl
+	push	bc
+	call	PrintStr	;HL behind the string
+	pop	bc
+	jr	3f
+2:	pop	bc
+	pop	hl
+	push	bc
+	xor	a		;skip the string
+	ld	b,a
+	ld	c,a
+	cpir
+	pop	bc
+3:	inc	b
+	jr	1b
+;
+;	Type the string at HL up to the zero, returns HL behind it
+;
+PrintStr:
+	ld	a,(hl)
+	inc	hl
+	or	a
+	ret	z
+	push	hl
+	call	Print
+	pop	hl
+	jr	PrintStr
+;
+;	-e: regular expression
+;
+;	The expression is parsed into its positions (char, [set], ., ^, $),
+;	each with the bytes it matches, and the positions that may follow
+;	each position (Glushkov automaton, no empty moves). ^ matches the LF
+;	before the line, $ the CR or LF at its end. The bytes that match the
+;	same positions share a byte class. The position sets reached from the
+;	line start become the DFA states, one page per class holds the next
+;	state of each state: a byte costs the lookup of its class and of the
+;	next state, with no backtracking. With more classes than pages or
+;	more than MAXSTATE states the position sets are stepped directly
+;	(bit-parallel NFA) with the follow unions of MakeTb.
+;
+ReCompile:
+	ld	hl,String
+	ld	(RePtr),hl
+	ld	hl,RecStk
+	ld	(RecSp),hl
+	ld	hl,Follow
+	ld	b,MAXPOS*4
+1:	ld	(hl),0
+	inc	hl
+	djnz	1b
+	xor	a
+	ld	(RePos),a
+	call	ParseAlt
+	ld	hl,(RePtr)
+	ld	a,(hl)
+	or	a
+	jp	nz,ReErr	;) without (
+	ld	hl,RecStk	;First, Last and Null of it all
+	ld	de,RFirst
+	ld	bc,9
+	ldir
+	call	MakeClasses
+	ld	hl,Nodes+255	;page aligned follow unions and DFA
+	ld	a,h
+	ld	(TbPage),a
+	add	a,16
+	ld	(DfaPage),a
+	call	MakeTb
+	ld	hl,RCur		;the line start from no position
+	ld	b,4
+2:	ld	(hl),0
+	inc	hl
+	djnz	2b
+	ld	a,(LfClass)
+	call	Step
+	ld	a,(RNull)
+	jr	z,3f
+	ld	a,1		;^ alone
+3:	ld	(AllMatch),a
+	ld	hl,RNext
+	ld	de,BolSet
+	ld	bc,4
+	ldir
+	jp	MakeDfa
+;
+ReErr:	ld	bc,BadRegex
+	call	PrintLine
+	jp	0
+;
+;	alt = cat { | cat }
+;	each part leaves its record (First, Last, Null) on the record stack
+;
+ParseAlt:
+	call	ParseCat
+1:	ld	hl,(RePtr)
+	ld	a,(hl)
+	cp	'|'
+	ret	nz
+	inc	hl
+	ld	(RePtr),hl
+	call	ParseCat
+	ld	hl,(RecSp)	;drop the second record
+	ld	de,-9
+	add	hl,de
+	ld	(RecSp),hl
+	ex	de,hl
+	ld	hl,-9
+	add	hl,de
+	ld	b,9		;and join it into the first one
+2:	ld	a,(de)
+	or	(hl)
+	ld	(hl),a
+	inc	hl
+	inc	de
+	djnz	2b
+	jr	1b
+;
+;	cat = { rep }
+;
+ParseCat:
+	call	PushRec		;the empty string
+	ld	de,8
+	add	hl,de
+	ld	(hl),1
+1:	ld	hl,(RePtr)
+	ld	a,(hl)
+	or	a
+	ret	z
+	cp	'|'
+	ret	z
+	cp	')'
+	ret	z
+	call	ParseRep
+	call	Concat
+	jr	1b
+;
+;	rep = atom { * | + | ? }
+;
+ParseRep:
+	call	ParseAtom
+1:	ld	hl,(RePtr)
+	ld	a,(hl)
+	cp	'*'
+	jr	z,2f
+	cp	'+'
+	jr	z,2f
+	cp	'?'
+	ret	nz
+2:	inc	hl
+	ld	(RePtr),hl
+	push	af
+	cp	'?'
+	jr	z,3f
+	ld	hl,(RecSp)	;* and +: the last positions
+	ld	de,-9		; may be followed by the first ones
+	add	hl,de
+	ex	de,hl
+	ld	hl,4
+	add	hl,de
+	call	AddFollow
+3:	pop	af
+	cp	'+'
+	jr	z,1b
+	ld	hl,(RecSp)	;* and ?: may be empty
+	dec	hl
+	ld	(hl),1
+	jr	1b
+;
+;	atom = ( alt ) | . | [set] | ^ | $ | \char | char
+;
+ParseAtom:
+	ld	hl,(RePtr)
+	ld	a,(hl)
+	inc	hl
+	ld	(RePtr),hl
+	cp	'('
+	jr	nz,1f
+	call	ParseAlt
+	ld	hl,(RePtr)
+	ld	a,(hl)
+	cp	')'
+	jp	nz,ReErr	;( without )
+	inc	hl
+	ld	(RePtr),hl
+	ret
+1:	cp	'*'		;nothing to repeat
+	jp	z,ReErr
+	cp	'+'
+	jp	z,ReErr
+	cp	'?'
+	jp	z,ReErr
+	call	NewPos		;HL=its bytes
+	cp	'.'
+	jr	nz,3f
+	ld	b,32		;any byte
+2:	ld	(hl),0FFH
+	inc	hl
+	djnz	2b
+	ld	de,-32
+	add	hl,de
+	jp	NoEol
+3:	cp	'['
+	jp	z,ParseSet
+	cp	'^'
+	jr	nz,4f
+	ld	a,LF
+	jp	SetBitHL
+4:	cp	'$'
+	jr	nz,5f
+	ld	a,CR
+	jp	SetBitHL
+5:	cp	5CH		;\: quoted char
+	jp	nz,AddChar
+	ld	de,(RePtr)
+	ld	a,(de)
+	or	a
+	jp	z,ReErr
+	inc	de
+	ld	(RePtr),de
+	jp	AddChar
+;
+;	[set] or [^set] of chars and ranges a-z, ] first and - last are chars
+;	HL = bytes of the position
+;
+ParseSet:
+	ld	de,(RePtr)
+	ld	a,(de)
+	sub	'^'		;A=0: negated
+	push	af
+	jr	nz,1f
+	inc	de
+1:	ld	a,(de)
+	cp	']'
+	jr	z,3f
+2:	ld	a,(de)
+	or	a
+	jp	z,ReErr		;[ without ]
+	cp	']'
+	jr	z,6f
+	cp	5CH		;\: quoted char
+	jr	nz,3f
+	inc	de
+	ld	a,(de)
+	or	a
+	jp	z,ReErr
+3:	inc	de
+	ld	b,a		;B=first char of the range
+	ld	a,(de)
+	cp	'-'
+	ld	a,b
+	jr	nz,5f		;single char
+	inc	de
+	ld	a,(de)
+	or	a
+	jr	z,4f
+	cp	']'
+	jr	z,4f
+	cp	5CH
+	jr	nz,8f
+	inc	de
+	ld	a,(de)
+	or	a
+	jp	z,ReErr
+8:	inc	de
+	cp	b
+	jp	c,ReErr		;range backwards
+	jr	5f
+4:	dec	de		;- at the end is a char
+	ld	a,b
+5:	push	de
+	ld	d,a		;D=last char of the range
+	ld	a,b
+9:	push	af
+	call	AddChar
+	pop	af
+	cp	d
+	inc	a
+	jr	c,9b
+	pop	de
+	jr	2b
+6:	inc	de		;behind ]
+	ld	(RePtr),de
+	pop	af
+	ret	nz
+	ld	b,32		;negated: all other bytes
+7:	ld	a,(hl)
+	cpl
+	ld	(hl),a
+	inc	hl
+	djnz	7b
+	ld	de,-32
+	add	hl,de
+NoEol:	inc	hl		;but neither CR, LF
+	ld	a,(hl)
+	and	0DBH
+	ld	(hl),a
+	inc	hl		; nor ^Z, the end of a text file
+	inc	hl
+	ld	a,(hl)
+	and	0FBH
+	ld	(hl),a
+	ret
+;
+;	Add the char A to the bytes HL of a position, with -i both cases
+;	HL, DE and B kept
+;
+AddChar:
+	push	af
+	call	SetBitHL
+	ld	a,(Opts)
+	and	OPT_I
+	jr	z,1f
+	pop	af
+	call	ToUpper
+	cp	'A'
+	ret	c
+	cp	'Z'+1
+	ret	nc
+	push	af
+	call	SetBitHL	;upper case
+	pop	af
+	or	20H		;lower case
+	jr	SetBitHL
+1:	pop	af
+	ret
+;
+;	Set the bit A in the bit set HL, only A and C affected
+;
+SetBitHL:
+	push	hl
+	call	BitAddr
+	or	(hl)
+	ld	(hl),a
+	pop	hl
+	ret
+;
+;	New position with no bytes yet, its record is pushed
+;	returns HL = its bytes, A kept
+;
+NewPos:
+	push	af
+	ld	a,(RePos)
+	cp	MAXPOS
+	jp	z,ReErr		;too many positions
+	inc	a
+	ld	(RePos),a
+	dec	a
+	push	af
+	call	PushRec		;First = Last = this position
+	pop	af
+	push	af
+	call	SetBitHL
+	ld	de,4
+	add	hl,de
+	pop	af
+	push	af
+	call	SetBitHL
+	pop	af
+	ld	l,a		;its bytes at PosCls + 32 * position
+	ld	h,0
+	add	hl,hl
+	add	hl,hl
+	add	hl,hl
+	add	hl,hl
+	add	hl,hl
+	ld	de,PosCls
+	add	hl,de
+	push	hl
+	ld	b,32
+1:	ld	(hl),0
+	inc	hl
+	djnz	1b
+	pop	hl
+	pop	af
+	ret
+;
+;	Push an empty record, returns HL = it
+;
+PushRec:
+	ld	hl,(RecSp)
+	ld	de,RECEND
+	or	a
+	sbc	hl,de
+	jp	nc,ReErr	;nested too deep
+	add	hl,de
+	push	hl
+	ld	b,9
+1:	ld	(hl),0
+	inc	hl
+	djnz	1b
+	ld	(RecSp),hl
+	pop	hl
+	ret
+;
+;	Concatenate the two records on top of the record stack
+;
+Concat:
+	ld	ix,(RecSp)	;IX-18: first record, IX-9: second one
+	push	ix
+	pop	hl
+	ld	de,-9
+	add	hl,de
+	ex	de,hl		;DE=First of the second
+	ld	hl,-5
+	add	hl,de		;HL=Last of the first
+	call	AddFollow
+	ld	a,(ix-10)	;first may be empty:
+	or	a		; starts with the second too
+	jr	z,1f
+	ld	a,(ix-9)
+	or	(ix-18)
+	ld	(ix-18),a
+	ld	a,(ix-8)
+	or	(ix-17)
+	ld	(ix-17),a
+	ld	a,(ix-7)
+	or	(ix-16)
+	ld	(ix-16),a
+	ld	a,(ix-6)
+	or	(ix-15)
+	ld	(ix-15),a
+1:	ld	a,(ix-1)	;second may be empty:
+	or	a		; ends with the first too
+	jr	nz,2f
+	ld	(ix-14),a
+	ld	(ix-13),a
+	ld	(ix-12),a
+	ld	(ix-11),a
+2:	ld	a,(ix-5)
+	or	(ix-14)
+	ld	(ix-14),a
+	ld	a,(ix-4)
+	or	(ix-13)
+	ld	(ix-13),a
+	ld	a,(ix-3)
+	or	(ix-12)
+	ld	(ix-12),a
+	ld	a,(ix-2)
+	or	(ix-11)
+	ld	(ix-11),a
+	ld	a,(ix-10)	;empty if both are
+	and	(ix-1)
+	ld	(ix-10),a
+	ld	de,-9
+	add	ix,de
+	ld	(RecSp),ix
+	ret
+;
+;	Add the positions DE to the follow sets of the positions HL
+;
+AddFollow:
+	ld	iy,Follow
+	ld	c,4
+1:	ld	a,(hl)
+	inc	hl
+	ld	b,8
+2:	rrca
+	jr	nc,3f
+	push	af
+	push	de
+	ld	a,(de)
+	or	(iy+0)
+	ld	(iy+0),a
+	inc	de
+	ld	a,(de)
+	or	(iy+1)
+	ld	(iy+1),a
+	inc	de
+	ld	a,(de)
+	or	(iy+2)
+	ld	(iy+2),a
+	inc	de
+	ld	a,(de)
+	or	(iy+3)
+	ld	(iy+3),a
+	pop	de
+	pop	af
+3:	inc	iy
+	inc	iy
+	inc	iy
+	inc	iy
+	djnz	2b
+	dec	c
+	jr	nz,1b
+	ret
+;
+;	Byte classes: the bytes matched by the same positions share a class,
+;	LF gets a class of its own. The skip page holds the class of each
+;	byte, ClassSet the positions of each class.
+;
+MakeClasses:
+	xor	a
+	ld	(NClass),a
+	ld	(ClsByte),a
+	dec	a
+	ld	(LfClass),a
+1:	ld	a,(ClsByte)
+	call	Sig		;RNext = positions of the byte
+	ld	a,(ClsByte)
+	cp	LF
+	jr	z,4f
+	ld	hl,ClassSet	;known class?
+	ld	c,0
+2:	ld	a,(NClass)
+	cp	c
+	jr	z,4f
+	ld	a,(LfClass)
+	cp	c
+	jr	z,3f
+	push	hl
+	ld	de,RNext
+	ld	b,4
+5:	ld	a,(de)
+	cp	(hl)
+	jr	nz,6f
+	inc	hl
+	inc	de
+	djnz	5b
+6:	pop	hl
+	jr	z,7f		;class C
+3:	ld	de,4
+	add	hl,de
+	inc	c
+	jr	2b
+4:	ld	a,(NClass)	;new class
+	inc	a
+	jp	z,ReErr		;too many classes
+	ld	(NClass),a
+	dec	a
+	ld	c,a
+	ld	l,a
+	ld	h,0
+	add	hl,hl
+	add	hl,hl
+	ld	de,ClassSet
+	add	hl,de
+	ex	de,hl
+	ld	hl,RNext
+	push	bc
+	ld	bc,4
+	ldir
+	pop	bc
+	ld	a,(ClsByte)
+	cp	LF
+	jr	nz,7f
+	ld	a,c
+	ld	(LfClass),a
+7:	ld	a,(SkipPage)	;class of the byte
+	ld	h,a
+	ld	a,(ClsByte)
+	ld	l,a
+	ld	(hl),c
+	cp	CR
+	jr	nz,8f
+	ld	a,c
+	ld	(CrClass),a
+8:	ld	hl,ClsByte
+	inc	(hl)
+	jr	nz,1b
+	ret
+;
+;	RNext = the positions that match the byte A
+;
+Sig:
+	ld	e,a
+	ld	hl,0
+	ld	(RNext),hl
+	ld	(RNext+2),hl
+	ld	b,l		;position
+	ld	hl,PosCls
+1:	ld	a,(RePos)
+	cp	b
+	ret	z
+	push	hl
+	ld	a,e
+	call	BitAddr
+	and	(hl)
+	jr	z,2f
+	ld	hl,RNext
+	ld	a,b
+	call	SetBitHL
+2:	pop	hl
+	ld	a,32
+	call	AddHL
+	inc	b
+	jr	1b
+;
+;	Follow unions: for byte i of a position set and each value v of it
+;	the union of the follow sets of the positions in v, its byte j at
+;	page TbPage + 4 * i + j, offset v
+;
+MakeTb:
+	ld	a,(TbPage)
+	ld	(TbP),a
+	ld	hl,Follow
+	ld	(TbF),hl
+	ld	c,4		;i
+1:	push	bc
+	ld	a,(TbP)
+	ld	h,a
+	ld	l,0
+	ld	b,4
+2:	ld	(hl),0		;v=0: no position
+	inc	h
+	djnz	2b
+	ld	b,1		;bit m of v
+3:	ld	c,b		;v = m .. 2*m-1 is v-m and position m
+4:	ld	a,c
+	sub	b
+	push	bc
+	ld	b,a		;B=v-m, C=v
+	ld	a,(TbP)
+	ld	h,a
+	ld	ix,(TbF)
+	ld	e,4
+5:	ld	l,b
+	ld	a,(hl)
+	or	(ix+0)
+	ld	l,c
+	ld	(hl),a
+	inc	h
+	inc	ix
+	dec	e
+	jr	nz,5b
+	pop	bc
+	inc	c
+	ld	a,c
+	sub	b
+	cp	b
+	jr	nz,4b
+	ld	hl,(TbF)	;follow set of the next position
+	ld	de,4
+	add	hl,de
+	ld	(TbF),hl
+	sla	b
+	jr	nz,3b
+	ld	a,(TbP)
+	add	a,4
+	ld	(TbP),a
+	pop	bc
+	dec	c
+	jr	nz,1b
+	ret
+;
+;	Step the positions RCur by a byte of class A into RNext: the follow
+;	sets of RCur and the first positions (a match may start at each byte),
+;	of them the positions of the class
+;	returns NZ if RNext holds a last position (match)
+;
+Step:
+	ld	l,a
+	ld	h,0
+	add	hl,hl
+	add	hl,hl
+	ld	de,ClassSet
+	add	hl,de
+	push	hl
+	ld	hl,RFirst
+	ld	de,RNext
+	ld	bc,4
+	ldir
+	ld	a,(TbPage)
+	ld	b,a
+	ld	hl,RCur
+	ld	c,4
+1:	ld	a,(hl)
+	inc	hl
+	or	a
+	jr	z,2f
+	push	hl
+	ld	l,a
+	ld	h,b
+	ld	de,RNext
+	ld	a,(de)
+	or	(hl)
+	ld	(de),a
+	inc	h
+	inc	de
+	ld	a,(de)
+	or	(hl)
+	ld	(de),a
+	inc	h
+	inc	de
+	ld	a,(de)
+	or	(hl)
+	ld	(de),a
+	inc	h
+	inc	de
+	ld	a,(de)
+	or	(hl)
+	ld	(de),a
+	pop	hl
+2:	ld	a,b
+	add	a,4
+	ld	b,a
+	dec	c
+	jr	nz,1b
+	pop	de		;positions of the class
+	ld	hl,RNext
+	ld	b,4
+3:	ld	a,(de)
+	and	(hl)
+	ld	(hl),a
+	inc	de
+	inc	hl
+	djnz	3b
+	ld	hl,RNext
+	ld	de,RLast
+	ld	bc,4*256
+4:	ld	a,(de)
+	and	(hl)
+	or	c
+	ld	c,a
+	inc	de
+	inc	hl
+	djnz	4b
+	ld	a,c
+	or	a
+	ret
+;
+;	Build the DFA from the line start state 0: the next state for state s
+;	and class k is stored at page DfaPage + k, offset s, with bit 7 set if
+;	it matches, 0FFH for LF. Falls back to the NFA if it does not fit.
+;
+MakeDfa:
+	ld	hl,Nodes+MAXNODE*NODE	;pages for the classes
+	ld	a,(DfaPage)
+	ld	b,a
+	ld	a,h
+	sub	b
+	ld	hl,NClass
+	cp	(hl)
+	jp	c,NfaMode
+	xor	a
+	ld	(NStates),a
+	ld	(DfaS),a
+	ld	hl,BolSet
+	ld	de,RNext
+	ld	bc,4
+	ldir
+	call	FindState	;state 0
+1:	ld	a,(DfaS)	;all states done?
+	ld	hl,NStates
+	cp	(hl)
+	jr	z,7f
+	ld	l,a		;RCur = positions of the state
+	ld	h,0
+	add	hl,hl
+	add	hl,hl
+	ld	de,DfaSet
+	add	hl,de
+	ld	de,RCur
+	ld	bc,4
+	ldir
+	ld	a,(CrClass)	;matches at the line end?
+	call	Step
+	ld	b,0
+	jr	z,2f
+	inc	b
+2:	ld	a,(DfaS)
+	ld	hl,EolAcc
+	call	AddHL
+	ld	(hl),b
+	xor	a
+	ld	(DfaK),a
+3:	ld	a,(DfaK)
+	ld	hl,LfClass
+	cp	(hl)
+	ld	b,0FFH		;LF: see FindRegex
+	jr	z,5f
+	call	Step
+	ld	b,0
+	jr	z,4f
+	ld	b,80H		;match
+4:	push	bc
+	call	FindState
+	pop	bc
+	jr	c,NfaMode	;too many states
+	or	b
+	ld	b,a
+5:	ld	a,(DfaPage)
+	ld	hl,DfaK
+	add	a,(hl)
+	ld	h,a
+	ld	a,(DfaS)
+	ld	l,a
+	ld	(hl),b
+	ld	hl,DfaK
+	inc	(hl)
+	ld	a,(NClass)
+	cp	(hl)
+	jr	nz,3b
+	ld	hl,DfaS
+	inc	(hl)
+	jr	1b
+7:	ld	a,(SkipPage)	;classes become the pages of the DFA
+	ld	h,a
+	ld	l,0
+	ld	a,(DfaPage)
+	ld	b,a
+8:	ld	a,(hl)
+	add	a,b
+	ld	(hl),a
+	inc	l
+	jr	nz,8b
+	xor	a
+	ld	(ReMode),a
+	ret
+NfaMode:
+	ld	a,1
+	ld	(ReMode),a
+	ret
+;
+;	State of the positions RNext, a new one if not found
+;	returns A = state or CARRY=1 if there are too many
+;
+FindState:
+	ld	hl,DfaSet
+	ld	c,0
+1:	ld	a,(NStates)
+	cp	c
+	jr	z,3f
+	push	hl
+	ld	de,RNext
+	ld	b,4
+2:	ld	a,(de)
+	cp	(hl)
+	jr	nz,4f
+	inc	hl
+	inc	de
+	djnz	2b
+4:	pop	hl
+	ld	a,c
+	ret	z		;CARRY=0 from cp
+	ld	de,4
+	add	hl,de
+	inc	c
+	jr	1b
+3:	cp	MAXSTATE
+	ccf
+	ret	c
+	inc	a
+	ld	(NStates),a
+	ex	de,hl
+	ld	hl,RNext
+	ld	bc,4
+	ldir
+	dec	a
+	ret
+;
+;	Search the buffer from HL with the regular expression
+;	returns CARRY=0 and HL = last char of the match or CARRY=1
+;
+FindRegex:
+	ld	de,(BufEnd)	;LF behind the data ends the loops
+	ld	a,LF
+	ld	(de),a
+	ex	de,hl		;DE=char
+	ld	a,(AllMatch)
+	or	a
+	jr	z,1f
+	ld	hl,(BufEnd)	;each line matches
+	or	a
+	sbc	hl,de
+	ex	de,hl
+	scf
+	ret	z
+	ld	a,(hl)		;but not the ^Z behind a text file
+	cp	EOF
+	scf
+	ret	z
+	or	a
+	ret
+1:	ld	a,(ReMode)
+	or	a
+	jr	nz,6f
+	ld	a,(SkipPage)	;B=class page, C=state
+	ld	b,a
+	ld	a,(ReState)
+	ld	c,a
+2:	ld	a,(de)		;next state by the class of the char
+	ld	l,a
+	ld	h,b
+	ld	h,(hl)
+	ld	l,c
+	ld	a,(hl)
+	or	a
+	jp	m,3f		;match or LF
+	ld	c,a
+	inc	de
+	jp	2b
+3:	inc	a
+	jr	nz,5f		;match
+	ld	hl,(BufEnd)	;LF: end of the buffer?
+	or	a
+	sbc	hl,de
+	jr	z,4f
+	ld	hl,EolAcc	;does the line match at its end?
+	ld	a,c
+	call	AddHL
+	ld	a,(hl)
+	or	a
+	jr	nz,9f
+	ld	c,a		;line start
+	inc	de
+	jp	2b
+4:	ld	a,c
+	ld	(ReState),a
+	scf
+	ret
+5:	dec	a
+	and	7FH
+	ld	(ReState),a
+9:	ex	de,hl		;HL=last char of the match
+	or	a
+	ret
+6:	ld	a,(de)		;NFA
+	cp	LF
+	jr	z,7f
+	ld	l,a
+	ld	a,(SkipPage)
+	ld	h,a
+	ld	a,(hl)		;class of the char
+	push	de
+	push	af
+	ld	hl,RState
+	ld	de,RCur
+	ld	bc,4
+	ldir
+	pop	af
+	call	Step
+	ld	hl,RNext
+	ld	de,RState
+	ld	bc,4
+	ldir			;flags kept
+	pop	de
+	jr	nz,9b
+	inc	de
+	jr	6b
+7:	ld	hl,(BufEnd)	;LF: end of the buffer?
+	or	a
+	sbc	hl,de
+	scf
+	ret	z
+	push	de
+	ld	hl,RState	;does the line match at its end?
+	ld	de,RCur
+	ld	bc,4
+	ldir
+	ld	a,(CrClass)
+	call	Step
+	jr	nz,8f
+	ld	hl,BolSet	;line start
+	ld	de,RState
+	ld	bc,4
+	ldir
+	pop	de
+	inc	de
+	jr	6b
+8:	pop	de
+	jr	9b
+;
+;	Line start for -e
+;
+ReReset:
+	xor	a
+	ld	(ReState),a
+	ld	hl,BolSet
+	ld	de,RState
+	ld	bc,4
+	ldir
+	ret
+;
+;	-z: ZIP and gzip archives
+;
+;	The members are inflated in memory into a 32K window: Buf and the
+;	-f area behind it. Each half of the window is searched as one fill,
+;	the inflater runs on its own stack and gives the halves to Fill
+;	(ZFill) as they are filled. Matches are typed as NAME.ZIP:member.
+;
+;	Open the archive at fcb, returns NZ for its first member, Z with
+;	Arc=0 for a plain file, Z with Arc<>0 if nothing is to be searched
+;
+ArcOpen:
+	xor	a
+	ld	(Arc),a
+	ld	(ArcErr),a
+	ld	(InEof),a
+	ld	a,(Opts)
+	and	OPT_Z
+	ret	z
+	call	SingleRec	;GetByte reads single records
+	ld	hl,TBUFF+128
+	ld	(InPtr),hl
+	ld	hl,-1		;no size
+	ld	(CLeft),hl
+	ld	(CLeft+2),hl
+	call	GetWord
+	ld	de,'K'*256+'P'
+	or	a
+	sbc	hl,de
+	jr	z,2f
+	add	hl,de
+	ld	de,8BH*256+1FH
+	or	a
+	sbc	hl,de
+	jr	z,3f
+1:	xor	a		;plain file, read it from the start
+	ld	(Arc),a
+	ld	(fcbcr),a
+	ret
+2:	call	GetWord		;PK 3 4: local header of ZIP
+	ld	de,0403H
+	or	a
+	sbc	hl,de
+	jr	nz,1b
+	ld	a,1
+	ld	(Arc),a
+	jp	ZipHdr
+3:	call	GetByte		;1F 8B 8: gzip, deflated
+	cp	8
+	jr	nz,1b
+	ld	a,2
+	ld	(Arc),a
+	call	GetByte
+	ld	(ZFlags),a
+	ld	hl,6		;time, extra flags, OS
+	call	SkipN
+	ld	a,(ZFlags)
+	and	4		;extra field
+	jr	z,4f
+	call	GetWord
+	call	SkipN
+4:	xor	a
+	ld	(MemName),a
+	ld	a,(ZFlags)
+	and	8		;original name
+	call	nz,GetZName
+	ld	a,(ZFlags)
+	and	10H		;comment
+	jr	z,6f
+5:	call	GetByte
+	or	a
+	jr	nz,5b
+6:	ld	a,(ZFlags)
+	and	2		;header CRC
+	ld	hl,2
+	call	nz,SkipN
+	xor	a
+	ld	(ZFlags),a
+	ld	a,8
+	ld	(ZMethod),a
+	jr	StartMember
+;
+;	Local header of a ZIP member behind PK 3 4
+;	returns NZ for a member to search, Z at the end of the archive
+;
+ZipHdr:
+	call	GetWord		;version
+	call	GetWord		;flags
+	ld	a,l
+	ld	(ZFlags),a
+	call	GetWord		;method
+	ld	a,h
+	or	a
+	ld	a,l
+	jr	z,1f
+	ld	a,0FFH		;unknown
+1:	ld	(ZMethod),a
+	ld	hl,8		;time, date, CRC
+	call	SkipN
+	call	GetWord
+	ld	(CSize),hl
+	call	GetWord
+	ld	(CSize+2),hl
+	ld	hl,4		;size
+	call	SkipN
+	call	GetWord		;length of the name
+	push	hl
+	call	GetWord		; and of the extra field
+	ex	(sp),hl
+	call	GetName
+	pop	hl
+	call	SkipN
+	ld	hl,(CSize)
+	ld	(CLeft),hl
+	ld	hl,(CSize+2)
+	ld	(CLeft+2),hl
+	ld	a,(InEof)
+	or	a
+	jr	nz,3f
+	ld	a,(ZMethod)
+	cp	8
+	jr	z,StartMember
+	ld	hl,ZFlags	;sizes behind the data: no way to skip it
+	bit	3,(hl)
+	jr	nz,3f
+	or	a
+	jr	z,StartMember	;stored
+	call	SkipLeft	;other methods are skipped
+;
+;	Next local header of the ZIP, returns Z if there is none
+;
+NextHdr:
+	call	GetWord
+	ld	de,'K'*256+'P'
+	or	a
+	sbc	hl,de
+	jr	nz,3f
+	call	GetWord
+	ld	de,0403H
+	or	a
+	sbc	hl,de
+	jr	z,ZipHdr
+3:	xor	a		;central directory or end
+	ret
+;
+;	Start the inflater for the member, returns NZ
+;
+StartMember:
+	ld	hl,Buf
+	ld	(OutPtr),hl
+	ld	hl,Buf+HALF
+	ld	(HalfEnd),hl
+	xor	a
+	ld	(BitCnt),a
+	ld	hl,InfMain
+	ld	(InfTop-2),hl
+	ld	hl,InfTop-10	;as left by Yield
+	ld	(InfSp),hl
+	inc	a
+	ret
+;
+;	The member is done, go to the next one
+;	returns NZ for the next member, Z if there is none
+;
+NextMember:
+	ld	a,(ArcErr)
+	or	a
+	jr	z,1f
+	call	CrLf
+	call	PrintName
+	ld	bc,BadData
+	call	PrintStr2
+	xor	a
+	ret
+1:	ld	a,(Arc)
+	cp	2		;gzip: one member
+	ret	z
+	ld	hl,ZFlags
+	bit	3,(hl)
+	jr	nz,2f
+	call	SkipLeft	;rest of the data
+	jr	NextHdr
+2:	ld	a,(Eof)		;sizes behind the data:
+	or	a		; inflate up to its end
+	jr	nz,3f
+	call	Fill
+	jr	2b
+3:	call	GetWord		;[PK 7 8] CRC, sizes
+	ld	de,'K'*256+'P'
+	or	a
+	sbc	hl,de
+	ld	hl,10
+	jr	nz,4f
+	ld	hl,14
+4:	call	SkipN
+	jr	NextHdr
+;
+;	Type the string at BC
+;
+PrintStr2:
+	ld	h,b
+	ld	l,c
+	jp	PrintStr
+;
+;	Skip the bytes of the member not read yet
+;
+SkipLeft:
+	call	LeftZero
+	ret	z
+	call	GetByte
+	ld	a,(InEof)
+	or	a
+	ret	nz
+	jr	SkipLeft
+;
+;	Z if CLeft = 0
+;
+LeftZero:
+	ld	hl,(CLeft)
+	ld	a,h
+	or	l
+	ld	hl,(CLeft+2)
+	or	h
+	or	l
+	ret
+;
+;	Read the name of HL chars into MemName
+;
+GetName:
+	ld	de,MemName
+	ld	b,MEMLEN-1
+1:	ld	a,h
+	or	l
+	jr	z,2f
+	call	GetByte
+	dec	hl
+	inc	b
+	dec	b
+	jr	z,1b		;too long: skip the rest
+	ld	(de),a
+	inc	de
+	dec	b
+	jr	1b
+2:	xor	a
+	ld	(de),a
+	ret
+;
+;	Read the name up to a zero into MemName
+;
+GetZName:
+	ld	de,MemName
+	ld	b,MEMLEN-1
+1:	call	GetByte
+	or	a
+	jr	z,2f
+	inc	b
+	dec	b
+	jr	z,1b
+	ld	(de),a
+	inc	de
+	dec	b
+	jr	1b
+2:	ld	(de),a
+	ret
+;
+;	Skip HL bytes
+;
+SkipN:
+	ld	a,h
+	or	l
+	ret	z
+	call	GetByte
+	dec	hl
+	jr	SkipN
+;
+;	HL = next two bytes of the archive
+;
+GetWord:
+	call	GetByte
+	ld	l,a
+	call	GetByte
+	ld	h,a
+	ret
+;
+;	A = next byte of the archive, 0 behind its end
+;	counts CLeft down, all other registers kept
+;
+GetByte:
+	push	hl
+	ld	hl,(InPtr)
+	ld	a,l
+	or	a
+	jr	nz,2f		;TBUFF+128 is 100H
+	push	bc
+	push	de
+	ld	de,TBUFF
+	call	SetDMA
+	ld	de,fcb
+	call	ReadRec
+	pop	de
+	pop	bc
+	ld	hl,TBUFF
+	jr	z,2f
+	ld	a,1		;end of file
+	ld	(InEof),a
+	ld	b,128
+1:	ld	(hl),0
+	inc	hl
+	djnz	1b
+	ld	l,TBUFF
+2:	ld	a,(hl)
+	inc	hl
+	ld	(InPtr),hl
+	push	af
+	ld	hl,(CLeft)
+	ld	a,h
+	or	l
+	dec	hl
+	ld	(CLeft),hl
+	jr	nz,3f
+	ld	hl,(CLeft+2)
+	dec	hl
+	ld	(CLeft+2),hl
+3:	pop	af
+	pop	hl
+	ret
+;
+;	Fill for -z: go on inflating up to the end of this half of the
+;	window or of the member
+;
+ZFill:
+	ld	(GrepSp),sp
+	ld	sp,(InfSp)
+	pop	hl
+	pop	de
+	pop	bc
+	pop	af
+	ret
+;
+;	Back to the search from the inflater, all registers kept
+;
+Yield:
+	push	af
+	push	bc
+	push	de
+	push	hl
+	ld	(InfSp),sp
+	ld	sp,(GrepSp)
+	ret
+;
+;	The inflater: copy or inflate the member
+;
+InfMain:
+	ld	a,(ZMethod)
+	or	a
+	jr	nz,2f
+1:	call	LeftZero	;stored
+	jr	z,InfDone
+	ld	a,(InEof)
+	or	a
+	jr	nz,ZErr
+	call	GetByte
+	call	Out
+	jr	1b
+2:	call	Inflate
+InfDone:
+	ld	hl,(HalfEnd)	;the last data of the member
+	ld	de,-HALF
+	add	hl,de
+	ld	(BufStart),hl
+	ex	de,hl
+	ld	hl,(OutPtr)
+	ld	(BufEnd),hl
+	ld	a,1
+	ld	(Eof),a
+	ld	a,(Opts)	;lines of a text file end at the
+	and	OPT_N+OPT_C	; first ^Z of its last record
+	jr	z,2f
+	or	a
+	sbc	hl,de		;HL=bytes of this half
+	jr	z,2f
+	ld	bc,128
+	sbc	hl,bc
+	add	hl,bc
+	jr	nc,1f
+	ld	b,h
+	ld	c,l
+1:	ld	hl,(BufEnd)
+	or	a
+	sbc	hl,bc
+	call	TrimEof
+2:	call	Yield		;there is nothing more
+	jr	2b
+;
+;	Bad data: end the member
+;
+ZErr:	ld	sp,InfTop
+	ld	a,1
+	ld	(ArcErr),a
+	jr	InfDone
+;
+;	Store A in the window, all other registers kept
+;
+Out:
+	push	hl
+	ld	hl,(OutPtr)
+	ld	(hl),a
+	inc	hl
+	ld	(OutPtr),hl
+	ld	a,(HalfEnd)
+	cp	l
+	jr	nz,1f
+	ld	a,(HalfEnd+1)
+	cp	h
+	call	z,Half
+1:	pop	hl
+	ret
+;
+;	A half of the window is filled: it is searched as one fill,
+;	the next fill follows it or starts at Buf again
+;
+Half:
+	push	bc
+	push	de
+	ld	hl,(HalfEnd)
+	ld	(BufEnd),hl
+	ld	de,-HALF
+	add	hl,de
+	ld	(BufStart),hl
+	ld	hl,(HalfEnd)
+	ld	de,WINEND
+	or	a
+	sbc	hl,de
+	ld	hl,(HalfEnd)
+	jr	nz,1f
+	ld	hl,Buf		;end of the window
+	ld	(OutPtr),hl
+1:	ld	(NextBuf),hl
+	ld	de,HALF
+	add	hl,de
+	ld	(HalfEnd),hl
+	call	Yield
+	pop	de
+	pop	bc
+	ret
+;
+;	Inflate the deflate stream (RFC 1951)
+;
+Inflate:
+1:	ld	a,(InEof)
+	or	a
+	jp	nz,ZErr
+	ld	b,1
+	call	GetBits
+	ld	a,l
+	ld	(Last),a
+	ld	b,2
+	call	GetBits		;block type
+	ld	a,l
+	cp	3
+	jp	z,ZErr
+	ld	hl,2f
+	push	hl
+	or	a
+	jr	z,Stored
+	dec	a
+	jp	z,Fixed
+	jp	Dynamic
+2:	ld	a,(Last)
+	or	a
+	jr	z,1b
+	ret
+;
+;	Stored block
+;
+Stored:
+	xor	a		;rest of the byte
+	ld	(BitCnt),a
+	call	GetWord		;length
+	push	hl
+	call	GetWord		;its complement
+	pop	hl
+1:	ld	a,h
+	or	l
+	ret	z
+	ld	a,(InEof)
+	or	a
+	jp	nz,ZErr
+	call	GetByte
+	call	Out
+	dec	hl
+	jr	1b
+;
+;	Block with the fixed codes
+;
+Fixed:
+	ld	hl,Lens
+	ld	a,8
+	ld	b,144
+	call	FillLen
+	ld	a,9
+	ld	b,112
+	call	FillLen
+	ld	a,7
+	ld	b,24
+	call	FillLen
+	ld	a,8
+	ld	b,8
+	call	FillLen
+	ld	a,5
+	ld	b,30
+	call	FillLen
+	ld	hl,LenTab
+	ld	de,Lens
+	ld	bc,288
+	call	Construct
+	ld	hl,DistTab
+	ld	de,Lens+288
+	ld	bc,30
+	call	Construct
+	jp	Codes
+FillLen:
+	ld	(hl),a
+	inc	hl
+	djnz	FillLen
+	ret
+;
+;	Block with its own codes, their lengths are coded, too
+;
+Dynamic:
+	ld	b,5
+	call	GetBits
+	ld	de,257
+	add	hl,de
+	ld	(NLen),hl
+	ld	b,5
+	call	GetBits
+	inc	hl
+	ld	(NDist),hl
+	ld	b,4
+	call	GetBits
+	ld	a,l
+	add	a,4
+	ld	c,a		;lengths of the code length code
+	ld	hl,Lens
+	ld	b,19
+1:	ld	(hl),0
+	inc	hl
+	djnz	1b
+	ld	ix,Order
+2:	ld	b,3
+	call	GetBits
+	ld	e,l
+	ld	a,(ix+0)
+	inc	ix
+	ld	hl,Lens
+	call	AddHL
+	ld	(hl),e
+	dec	c
+	jr	nz,2b
+	ld	hl,DistTab	;code length code
+	ld	de,Lens
+	ld	bc,19
+	call	Construct
+	ld	hl,(NLen)
+	ld	de,(NDist)
+	add	hl,de
+	ld	(NAll),hl
+	ld	hl,Lens
+	ld	(LPtr),hl
+3:	ld	hl,(NAll)	;all lengths read?
+	ld	de,Lens
+	add	hl,de
+	ld	de,(LPtr)
+	or	a
+	sbc	hl,de
+	jr	z,8f
+	ld	hl,DistTab
+	call	Decode
+	ld	a,l
+	cp	16
+	jr	nc,4f
+	ld	hl,(LPtr)	;a length
+	ld	(hl),a
+	inc	hl
+	ld	(LPtr),hl
+	jr	3b
+4:	ld	c,0		;repeat zero
+	cp	16
+	jr	nz,5f
+	ld	hl,(LPtr)	; or the last length
+	ld	de,Lens
+	or	a
+	sbc	hl,de
+	jp	z,ZErr
+	add	hl,de
+	dec	hl
+	ld	c,(hl)
+	ld	b,2
+	call	GetBits
+	ld	a,3
+	jr	7f
+5:	cp	17
+	jr	nz,6f
+	ld	b,3
+	call	GetBits
+	ld	a,3
+	jr	7f
+6:	ld	b,7
+	call	GetBits
+	ld	a,11
+7:	add	a,l
+	ld	b,a		;times
+	ld	hl,(LPtr)
+	call	AddHL
+	ex	de,hl		;DE=behind them
+	ld	hl,(NAll)
+	push	de
+	ld	de,Lens
+	add	hl,de
+	pop	de
+	or	a
+	sbc	hl,de
+	jp	c,ZErr		;too many
+	ld	hl,(LPtr)
+9:	ld	(hl),c
+	inc	hl
+	djnz	9b
+	ld	(LPtr),hl
+	jr	3b
+8:	ld	hl,LenTab
+	ld	de,Lens
+	ld	bc,(NLen)
+	call	Construct
+	ld	hl,(NLen)
+	ld	de,Lens
+	add	hl,de
+	ex	de,hl
+	ld	hl,DistTab
+	ld	bc,(NDist)
+	call	Construct
+;
+;	Decode the literals and copies of a block
+;
+Codes:
+1:	ld	hl,LenTab
+	call	Decode
+	ld	a,h
+	or	a
+	jr	nz,2f
+	ld	a,l		;literal
+	call	Out
+	jr	1b
+2:	ld	a,l
+	or	a
+	ret	z		;end of block
+	dec	a
+	cp	29
+	jp	nc,ZErr
+	ld	c,a		;length
+	ld	hl,LExt
+	call	AddHL
+	ld	b,(hl)
+	call	GetBits
+	push	hl
+	ld	a,c
+	add	a,a
+	ld	hl,LBase
+	call	AddHL
+	ld	a,(hl)
+	inc	hl
+	ld	h,(hl)
+	ld	l,a
+	pop	de
+	add	hl,de
+	ld	(CopyLen),hl
+	ld	hl,DistTab	;distance
+	call	Decode
+	ld	a,h
+	or	a
+	jp	nz,ZErr
+	ld	a,l
+	cp	30
+	jp	nc,ZErr
+	ld	c,a
+	ld	hl,DExt
+	call	AddHL
+	ld	b,(hl)
+	call	GetBits
+	push	hl
+	ld	a,c
+	add	a,a
+	ld	hl,DBase
+	call	AddHL
+	ld	a,(hl)
+	inc	hl
+	ld	h,(hl)
+	ld	l,a
+	pop	de
+	add	hl,de
+	ex	de,hl
+	ld	hl,(OutPtr)	;copy from there
+	or	a
+	sbc	hl,de
+	jr	c,3f
+	ld	de,Buf
+	push	hl
+	sbc	hl,de
+	pop	hl
+	jr	nc,4f
+3:	ld	de,2*HALF	;in front of Buf: at the end of the window
+	add	hl,de
+4:	ld	bc,(CopyLen)
+	ld	de,WINEND
+5:	ld	a,(hl)
+	call	Out
+	inc	hl
+	ld	a,l
+	cp	e
+	jr	nz,6f
+	ld	a,h
+	cp	d
+	jr	nz,6f
+	ld	hl,Buf
+6:	dec	bc
+	ld	a,b
+	or	c
+	jr	nz,5b
+	jp	1b
+;
+;	HL = next B bits of the stream, B = 0 .. 16
+;	C kept
+;
+GetBits:
+	ld	hl,0
+	ld	a,b
+	or	a
+	ret	z
+	ld	de,1
+1:	call	GetBit
+	jr	nc,2f
+	ld	a,l
+	or	e
+	ld	l,a
+	ld	a,h
+	or	d
+	ld	h,a
+2:	sla	e
+	rl	d
+	djnz	1b
+	ret
+;
+;	CARRY = next bit of the stream, only A affected
+;
+GetBit:
+	ld	a,(BitCnt)
+	or	a
+	jr	nz,1f
+	call	GetByte
+	ld	(BitBuf),a
+	ld	a,8
+1:	dec	a
+	ld	(BitCnt),a
+	ld	a,(BitBuf)
+	srl	a
+	ld	(BitBuf),a
+	ret
+;
+;	Decode a symbol with the canonical code HL, bit by bit:
+;	the codes of each length follow the ones of the shorter lengths
+;	returns HL = symbol
+;
+Decode:
+	ld	a,(InEof)
+	or	a
+	jp	nz,ZErr
+	ld	(DecTab),hl
+	inc	hl
+	inc	hl
+	ld	(DecCnt),hl	;count of length 1
+	ld	de,0		;DE=code
+	ld	b,d		;BC=first code of this length
+	ld	c,e
+	ld	(DecIdx),de
+	ld	a,15
+	ld	(DecLen),a
+1:	call	GetBit
+	jr	nc,2f
+	inc	de
+2:	ld	hl,(DecCnt)
+	ld	a,(hl)
+	inc	hl
+	ld	h,(hl)
+	ld	l,a		;HL=count
+	push	hl
+	push	de
+	ex	de,hl
+	or	a
+	sbc	hl,bc		;code-first < count?
+	push	hl
+	or	a
+	sbc	hl,de
+	pop	hl
+	jr	c,3f
+	pop	de
+	pop	hl
+	push	hl
+	add	hl,bc		;next first = (first+count)*2
+	add	hl,hl
+	ld	b,h
+	ld	c,l
+	pop	hl
+	push	de
+	ld	de,(DecIdx)
+	add	hl,de
+	ld	(DecIdx),hl
+	pop	de
+	sla	e		;code*2
+	rl	d
+	ld	hl,(DecCnt)
+	inc	hl
+	inc	hl
+	ld	(DecCnt),hl
+	ld	hl,DecLen
+	dec	(hl)
+	jr	nz,1b
+	jp	ZErr		;no code
+3:	pop	de
+	pop	de
+	ld	de,(DecIdx)
+	add	hl,de
+	add	hl,hl
+	ld	de,(DecTab)
+	add	hl,de
+	ld	de,32		;the symbols follow the counts
+	add	hl,de
+	ld	a,(hl)
+	inc	hl
+	ld	h,(hl)
+	ld	l,a
+	ret
+;
+;	Canonical code HL from the BC lengths DE: counts of each length,
+;	then the symbols ordered by length
+;
+Construct:
+	ld	(CTab),hl
+	ld	(CLen),de
+	ld	(CN),bc
+	ld	b,32
+1:	ld	(hl),0
+	inc	hl
+	djnz	1b
+	ld	hl,(CLen)	;count the lengths
+	ld	bc,(CN)
+2:	ld	a,(hl)
+	inc	hl
+	push	hl
+	add	a,a
+	ld	hl,(CTab)
+	call	AddHL
+	inc	(hl)
+	jr	nz,3f
+	inc	hl
+	inc	(hl)
+3:	pop	hl
+	dec	bc
+	ld	a,b
+	or	c
+	jr	nz,2b
+	ld	hl,(CTab)	;first symbol of each length
+	inc	hl
+	inc	hl
+	ld	ix,Offs+2
+	ld	de,0
+	ld	(ix+0),e
+	ld	(ix+1),d
+	ld	b,14
+4:	ld	a,(hl)
+	inc	hl
+	add	a,e
+	ld	e,a
+	ld	a,(hl)
+	inc	hl
+	adc	a,d
+	ld	d,a
+	inc	ix
+	inc	ix
+	ld	(ix+0),e
+	ld	(ix+1),d
+	djnz	4b
+	ld	hl,(CLen)	;the symbols
+	ld	de,0
+5:	ld	a,(hl)
+	or	a
+	jr	z,6f
+	push	hl
+	push	de
+	add	a,a
+	ld	hl,Offs
+	call	AddHL
+	ld	c,(hl)
+	inc	hl
+	ld	b,(hl)
+	inc	bc
+	ld	(hl),b
+	dec	hl
+	ld	(hl),c
+	dec	bc
+	ld	h,b
+	ld	l,c
+	add	hl,hl
+	ld	bc,(CTab)
+	add	hl,bc
+	ld	bc,32
+	add	hl,bc
+	ld	(hl),e
+	inc	hl
+	ld	(hl),d
+	pop	de
+	pop	hl
+6:	inc	hl
+	inc	de
+	ld	bc,(CN)
+	ld	a,e
+	cp	c
+	jr	nz,5b
+	ld	a,d
+	cp	b
+	jr	nz,5b
+	ret
 ;
 	end	start
@@ -42,3 +42,17 @@ begin
   b1 := b and $0F;
   WriteNibble (b1)
 end;
+
+
+Var
+  HexTab: array [0..255] of string2; { two hex digits of each byte value }
+
+Procedure InitHex; { fill HexTab, call once at program start }
+Const
+  Digits: string[16] = '0123456789ABCDEF';
+Var
+  b: integer;
+begin
+  for b := 0 to 255 do
+    HexTab[b] := Digits[b shr 4 + 1] + Digits[b and $0F + 1]
+end;
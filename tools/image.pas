@@ -0,0 +1,323 @@
+{ INCLUDE-FILE IMAGE.PAS: }
+{ dump / restore / verify drive images, optional CRC-32 per track }
+
+{ The image is the raw content of tracks FirstTrack .. LastTrack,    }
+{ sectors in physical order.  The CRC file NAME.CRC beside the image }
+{ holds one CRC-32 (4 bytes, LSB first) for each track of the image. }
+
+{ Sync with an image on the other side (e.g. imgedit on Linux) via   }
+{ a shared drive: (C)rc writes only NAME.CRC of the drive, (U)pdate  }
+{ compares the drive with the NAME.CRC of the other side and writes  }
+{ the changed tracks into the update file NAME.typ, (A)pply writes   }
+{ the tracks of such an update file onto the drive.  An update file  }
+{ holds for each track a header record (track number, CRC-32 of the  }
+{ track, LSB first, rest 0) and the track data, track $FFFF ends it. }
+
+
+Type
+  FCB_t = record                  { CP/M file control block  }
+    DR:       byte;
+    Name:     array [1..11] of char;
+    EX, S1, S2, RC: byte;
+    D:        array [0..15] of byte;
+    CR, R0, R1, R2: byte
+  end;
+  String14 = string[14];
+  String20 = string[20];
+
+Var
+  ImgFCB, CrcFCB: FCB_t;
+  CrcRec:         array [0..63] of integer;  { 32 CRC-32 per record }
+
+
+Function FileOpen( Var F: FCB_t; Name: String14; Create: boolean ): boolean;
+{ parse Name into F and open or create the file }
+Var
+  PFCB: record
+    Str, FCB: integer
+  end;
+  s:    string[15];
+begin
+  s := Name + chr( 0 );
+  PFCB.Str := Addr( s[1] );
+  PFCB.FCB := Addr( F );
+  FillChar( F, 36, 0 );
+  if BdosHL( 152, Addr( PFCB ) ) = -1 then  { parse file name }
+    FileOpen := false
+  else if Create then
+    begin
+      Bdos( 19, Addr( F ) );                  { delete file }
+      FileOpen := Bdos( 22, Addr( F ) ) <> $FF  { make file }
+    end
+  else
+    FileOpen := Bdos( 15, Addr( F ) ) <> $FF    { open file }
+end;
+
+
+Function FileBlock( Var F: FCB_t; Fn, Buf, Recs: integer ): boolean;
+{ sequential read (Fn = 20) or write (Fn = 21) of Recs records at Buf }
+{ with one multi sector BDOS call, Recs <= 128                        }
+begin
+  Bdos( 26, Buf );                      { set DMA address      }
+  Bdos( 44, Recs );                     { multi sector count   }
+  FileBlock := Bdos( Fn, Addr( F ) ) = 0;
+  Bdos( 44, 1 )
+end;
+
+
+Procedure Image; { dump / restore / verify / sync tracks }
+Var
+  Mode:        char;
+  ImgName,
+  CrcName:     String14;
+  UseCrc, Ok,
+  ImgOpen,
+  CrcOpen:     boolean;     { files to close at the end }
+  Trk, Recs,
+  Idx, Errors,
+  Count:       integer;
+  HdrRec:      array [0..63] of integer;  { update file track header }
+
+Procedure Fail( Msg: String20 );
+begin
+  GotoXY( 1, USRLINE + 6 );
+  Write( Msg, ' at track ', Trk );
+  Ok := false
+end;
+
+Function CrcMatch: boolean; { compare track CRC with next entry }
+begin
+  if Idx = 0 then
+    if not FileBlock( CrcFCB, 20, Addr( CrcRec ), 1 ) then
+      Fail( 'CRC file end' );
+  CrcMatch := ( CrcRec[2*Idx] = CrcLo ) and ( CrcRec[2*Idx+1] = CrcHi );
+  Idx := ( Idx + 1 ) mod 32
+end;
+
+begin
+  Mode := UserFrame( ImageTracks ); { No / Dump / Restore / Verify / }
+                                    { Crc / Update / Apply         }
+  if Mode = 'N' then
+    Exit;  { user abort }
+  BufferValid := False;
+  GotoXY( 1, USRLINE + 6 );
+  if not TrackFits then
+    begin
+      Write( 'Track too large for buffer.' );
+      Exit
+    end;
+  Recs := PhySecs * ( Psize div 128 );
+  GotoXY( 1, USRLINE + 4 );
+  if Mode in ['U', 'A'] then
+    Write( 'UPDATE FILE     (d:name.typ): ' )
+  else
+    Write( 'IMAGE FILE      (d:name.typ): ' );
+  readln( ImgName );
+  for i := 1 to length( ImgName ) do
+    ImgName[i] := UpCase( ImgName[i] );
+  if ( length( ImgName ) < 3 ) or ( ImgName[2] <> ':' )
+  or ( ImgName[1] = DriveChr ) then
+    begin
+      GotoXY( 1, USRLINE + 6 );
+      Write( 'Image must be on another drive.' );
+      Exit
+    end;
+  i := Pos( '.', ImgName );
+  if i = 0 then
+    CrcName := ImgName
+  else
+    CrcName := Copy( ImgName, 1, i - 1 );
+  CrcName := CrcName + '.CRC';
+  if ImgName = CrcName then         { would delete one with the other }
+    begin
+      GotoXY( 1, USRLINE + 6 );
+      Write( 'Image must not be a .CRC file.' );
+      Exit
+    end;
+
+  Ok := true;
+  ImgOpen := false;
+  CrcOpen := false;
+  Errors := 0;
+  Count := 0;
+  Trk := FirstTrack;
+  case Mode of
+    'D': begin
+           GotoXY( 1, USRLINE + 5 );
+           Write( 'WITH CRC FILE?  (Y/N): N', chr( 8 ) );
+           UseCrc := UpCase( char( Bdos( 1 ) ) ) = 'Y';
+           ImgOpen := FileOpen( ImgFCB, ImgName, true );
+           if not ImgOpen then
+             Fail( 'Cannot create' );
+           if Ok and UseCrc then
+             begin
+               CrcOpen := FileOpen( CrcFCB, CrcName, true );
+               if not CrcOpen then
+                 Fail( 'Cannot create' )
+             end
+         end;
+    'R': begin
+           ImgOpen := FileOpen( ImgFCB, ImgName, false );
+           if not ImgOpen then
+             Fail( 'Cannot open' );
+           CrcOpen := FileOpen( CrcFCB, CrcName, false );
+           UseCrc := CrcOpen
+         end;
+    'V': begin
+           UseCrc := true;
+           CrcOpen := FileOpen( CrcFCB, CrcName, false );
+           if not CrcOpen then
+             Fail( 'Cannot open' )
+         end;
+    'C': begin
+           UseCrc := true;
+           CrcOpen := FileOpen( CrcFCB, CrcName, true );
+           if not CrcOpen then
+             Fail( 'Cannot create' )
+         end;
+    'U': begin
+           UseCrc := true;
+           CrcOpen := FileOpen( CrcFCB, CrcName, false );
+           if not CrcOpen then
+             Fail( 'Cannot open' );
+           if Ok then
+             begin
+               ImgOpen := FileOpen( ImgFCB, ImgName, true );
+               if not ImgOpen then
+                 Fail( 'Cannot create' )
+             end
+         end;
+    'A': begin
+           UseCrc := false;
+           ImgOpen := FileOpen( ImgFCB, ImgName, false );
+           if not ImgOpen then
+             Fail( 'Cannot open' )
+         end
+  end;
+
+  Idx := 0;
+  if Mode = 'A' then
+    repeat          { header and data of each changed track }
+      if not FileBlock( ImgFCB, 20, Addr( HdrRec ), 1 ) then
+        Fail( 'Update file end' )
+      else
+        Trk := HdrRec[0];
+      if Ok and ( Trk <> -1 ) then
+        begin
+          GotoXY( 1, USRLINE + 5 );
+          Write( 'APPLY   track ', Trk:3, '  ' );
+          if ( Trk < FirstTrack ) or ( Trk > LastTrack ) then
+            Fail( 'Out of range' )
+          else if not FileBlock( ImgFCB, 20, Addr( TrackBuf ), Recs ) then
+            Fail( 'Update file end' );
+          if Ok then
+            begin
+              TrackCrc( Recs * 128 );
+              if ( CrcLo <> HdrRec[1] ) or ( CrcHi <> HdrRec[2] ) then
+                Fail( 'Update CRC error' )
+              else if TrackIO( 14, Trk, Psize ) <> 0 then
+                Fail( 'Write error' )
+              else
+                Count := Count + 1
+            end
+        end
+    until not Ok or ( Trk = -1 );
+  while Ok and ( Mode <> 'A' ) and ( Trk <= LastTrack ) do
+    begin
+      GotoXY( 1, USRLINE + 5 );
+      case Mode of
+        'D': Write( 'DUMP    track ' );
+        'R': Write( 'RESTORE track ' );
+        'V': Write( 'VERIFY  track ' );
+        'C': Write( 'CRC     track ' );
+        'U': Write( 'UPDATE  track ' )
+      end;
+      Write( Trk:3, '  ' );
+      if Mode = 'R' then
+        begin
+          if not FileBlock( ImgFCB, 20, Addr( TrackBuf ), Recs ) then
+            Fail( 'Image file end' );
+          if Ok and UseCrc then
+            begin
+              TrackCrc( Recs * 128 );
+              if not CrcMatch then
+                if Ok then  { not at CRC file end }
+                  Fail( 'Image CRC error' )
+            end;
+          if Ok then
+            if TrackIO( 14, Trk, Psize ) <> 0 then
+              Fail( 'Write error' )
+        end
+      else
+        begin
+          if TrackIO( 13, Trk, Psize ) <> 0 then
+            Fail( 'Read error' );
+          if Ok and UseCrc then
+            TrackCrc( Recs * 128 );
+          if Ok and ( Mode = 'D' ) then
+            if not FileBlock( ImgFCB, 21, Addr( TrackBuf ), Recs ) then
+              Fail( 'Disk full' );
+          if Ok and UseCrc and ( Mode in ['D', 'C'] ) then
+            begin
+              CrcRec[2*Idx] := CrcLo;
+              CrcRec[2*Idx+1] := CrcHi;
+              Idx := ( Idx + 1 ) mod 32;
+              if Idx = 0 then
+                if not FileBlock( CrcFCB, 21, Addr( CrcRec ), 1 ) then
+                  Fail( 'Disk full' )
+            end;
+          if Ok and ( Mode in ['V', 'U'] ) then
+            if not CrcMatch then
+              if Ok then   { not at CRC file end }
+                if Mode = 'V' then
+                  begin    { report bad track and go on }
+                    Errors := Errors + 1;
+                    GotoXY( 1, USRLINE + 6 );
+                    Write( Errors, ' CRC errors, last at track ', Trk )
+                  end
+                else
+                  begin    { changed track into the update file }
+                    FillChar( HdrRec, 128, 0 );
+                    HdrRec[0] := Trk;
+                    HdrRec[1] := CrcLo;
+                    HdrRec[2] := CrcHi;
+                    if not FileBlock( ImgFCB, 21, Addr( HdrRec ), 1 ) then
+                      Fail( 'Disk full' )
+                    else if not FileBlock( ImgFCB, 21, Addr( TrackBuf ), Recs ) then
+                      Fail( 'Disk full' )
+                    else
+                      Count := Count + 1
+                  end
+        end;
+      Trk := Trk + 1
+    end;
+
+  if ( Mode in ['D', 'C'] ) and CrcOpen and ( Idx > 0 ) then
+    begin
+      FillChar( CrcRec[2*Idx], 4 * ( 32 - Idx ), 0 );
+      if not FileBlock( CrcFCB, 21, Addr( CrcRec ), 1 ) then
+        Fail( 'Disk full' )
+    end;
+  if Ok and ( Mode = 'U' ) then
+    begin
+      FillChar( HdrRec, 128, 0 );
+      HdrRec[0] := -1;                { end of update file }
+      if not FileBlock( ImgFCB, 21, Addr( HdrRec ), 1 ) then
+        Fail( 'Disk full' )
+    end;
+  if ImgOpen then
+    Bdos( 16, Addr( ImgFCB ) );   { close the opened files }
+  if CrcOpen then
+    Bdos( 16, Addr( CrcFCB ) );
+  if Mode in ['R', 'A'] then
+    Bdos( 37, 1 shl Drive );      { reset drive, directory changed }
+  if Ok and ( Errors = 0 ) then
+    begin
+      GotoXY( 1, USRLINE + 6 );
+      case Mode of
+        'U': Write( Count, ' changed tracks' );
+        'A': Write( Count, ' tracks written' )
+        else Write( LastTrack - FirstTrack + 1, ' tracks o.k.' )
+      end
+    end
+end;
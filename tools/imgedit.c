@@ -0,0 +1,621 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * imgedit.c - Linux counterpart of DISKEDIT.COM for CP/M disk image files.
+ *
+ * The image file holds the raw tracks of a CP/M drive, the sectors of each
+ * track in physical order, as written by the diskedit 'Image' command or
+ * used by most emulators. The image is mapped into memory with mmap(), all
+ * operations work directly on the mapping.
+ *
+ * The disk geometry is given as CP/M 3 disk parameter block (DPB) and an
+ * optional sector translation table; logical 128 byte sectors are located
+ * exactly as diskedit does it with the BIOS (SECTRAN and deblocking):
+ *
+ *   physical sector = xlt[ logical sector / ( 1 << PSH ) ]
+ *   offset          = ( logical sector % ( 1 << PSH ) ) * 128
+ *
+ * Commands (interactive, from a script file or from stdin):
+ *   r TRACK SECTOR      read logical sector into buffer and show it
+ *   n / p               read next / previous logical sector
+ *   d                   show buffer again
+ *   m ADDR HEX HEX ...  modify buffer from hex address ADDR (00..7F)
+ *   m ADDR 'TEXT        modify buffer with ASCII text
+ *   w                   write buffer back to the current sector
+ *   f FIRST [LAST]      format tracks (fill with E5), directory tracks
+ *                       get timestamp entries ('!' at offset 60h)
+ *   i                   INITDIR, format the directory tracks
+ *   c CRCFILE           write CRC-32 of every image track into CRCFILE
+ *   u CRCFILE UPDFILE   write all tracks whose CRC-32 differs from
+ *                       CRCFILE into the update file UPDFILE
+ *   a UPDFILE           write the tracks of update file UPDFILE
+ *   q                   quit
+ * Numbers are decimal or C style hex (0x..), ADDR and HEX are always hex.
+ * Empty lines and lines starting with '#' are ignored. In a script every
+ * error terminates the program with exit code 1.
+ *
+ * Differential sync with diskedit 'Image' via a shared drive uses the same
+ * files as diskedit, the CRC file holds one CRC-32 (LSB first) per track,
+ * padded to 128 byte records, an update file holds for each changed track
+ * a 128 byte header (track number, CRC-32, LSB first, rest 0) and the
+ * track data; the header with track number FFFFh ends the file.
+ *   CP/M -> Linux: 'c DISK.CRC', diskedit (U)pdate, 'a DISK.UPD'
+ *   Linux -> CP/M: diskedit (C)rc, 'u DISK.CRC DISK.UPD', diskedit (A)pply
+ * Both sides must use the same track range (-t and FIRST TRACK).
+ *
+ * Building on Linux:
+ *   gcc -Wall -Wextra -Wpedantic -std=c89 -o imgedit imgedit.c
+ *
+ * License: GPL-3.0-or-later
+ */
+
+#define VERSION "20261018"
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <ctype.h>    /* isspace, tolower */
+#include <stdint.h>   /* uint32_t */
+#include <stdio.h>    /* printf, fgets, fopen */
+#include <stdlib.h>   /* strtol, malloc, exit */
+#include <string.h>   /* memcpy, memset */
+#include <fcntl.h>    /* open */
+#include <sys/mman.h> /* mmap, munmap, msync */
+#include <sys/stat.h> /* fstat */
+#include <unistd.h>   /* close, isatty */
+
+
+/* -------------------- DISK GEOMETRY -------------------- */
+
+/* CP/M 3.0 disk parameter block, see diskedit.pas */
+struct dpb {
+    int spt; /* number of log. Sectors Per Track */
+    int bsh; /* Block SHift                      */
+    int blm; /* BLock Mask                       */
+    int exm; /* block EXtent Mask                */
+    int dsm; /* blocks on disk -1                */
+    int drm; /* directory entries - 1            */
+    int off; /* reserv. tracks, start of dir.    */
+    int psh; /* physical record shift            */
+    int psm; /* physical record mask             */
+};
+
+/* default: 8" IBM 3740 SSSD, 26 sectors, skew 6 */
+struct dpb dpb = { 26, 3, 7, 0, 242, 63, 2, 0, 0 };
+
+#define MAX_PHYSEC 256
+int xlt[ MAX_PHYSEC ] = { 1,  7,  13, 19, 25, 5,  11, 17, 23, 3,  9,  15, 21,
+                          2,  8,  14, 20, 26, 6,  12, 18, 24, 4,  10, 16, 22 };
+int n_xlt = 26; /* 0: no translation */
+
+/* derived values, same names as in diskedit.pas */
+int psize, log_per_phy, phy_secs, phy_base;
+int dir_track, data_track, max_track;
+long track_size;
+
+
+/* -------------------- IMAGE -------------------- */
+
+unsigned char *image = NULL; /* mmap()ed image file */
+long image_size;
+int first_track = 0; /* track number of the first track in the image */
+int img_tracks;      /* tracks in the image */
+int read_only = 0;
+
+unsigned char buf[ 128 ];        /* logical sector buffer */
+unsigned char *track_buf = NULL; /* one track of an update file */
+int track = -1, sector = 0;
+int quiet = 0;
+
+
+void fail( const char *msg ) {
+    fprintf( stderr, "imgedit: %s\n", msg );
+    exit( 1 );
+}
+
+
+/* parse a comma separated list of numbers, return count */
+int parse_list( const char *s, int *v, int max ) {
+    int n = 0;
+    char *end;
+    while ( n < max ) {
+        v[ n++ ] = (int)strtol( s, &end, 0 );
+        if ( end == s )
+            fail( "invalid number list" );
+        if ( *end != ',' )
+            break;
+        s = end + 1;
+    }
+    return n;
+}
+
+
+/* calculate the drive layout like UserFrame() in diskedit.pas */
+void init_geometry( void ) {
+    int s;
+    long k;
+    psize = 128 << dpb.psh;
+    log_per_phy = 1 << dpb.psh;
+    phy_secs = dpb.spt / log_per_phy;
+    if ( phy_secs < 1 || phy_secs > MAX_PHYSEC )
+        fail( "invalid SPT / PSH" );
+    dir_track = dpb.off;
+    data_track = dir_track + ( dpb.drm / 4 / dpb.spt ) + 1;
+    k = (long)( dpb.dsm + 1 ) * ( ( dpb.blm + 1 ) / 8 ); /* KB capacity */
+    max_track = (int)( ( k * 8 + dpb.spt - 1 ) / dpb.spt ) + dpb.off; /* with partial last track */
+    track_size = (long)phy_secs * psize;
+    if ( n_xlt == 0 ) { /* no translation */
+        for ( s = 0; s < phy_secs; ++s )
+            xlt[ s ] = s;
+    } else if ( n_xlt != phy_secs )
+        fail( "skew table needs one entry per physical sector" );
+    phy_base = xlt[ 0 ];
+    for ( s = 1; s < phy_secs; ++s )
+        if ( xlt[ s ] < phy_base )
+            phy_base = xlt[ s ];
+    for ( s = 0; s < phy_secs; ++s )
+        if ( xlt[ s ] < phy_base || xlt[ s ] - phy_base >= phy_secs )
+            fail( "skew table out of range" );
+}
+
+
+/* address of image track trk */
+unsigned char *track_ptr( int trk ) {
+    return image + ( trk - first_track ) * track_size;
+}
+
+
+/* address of log. sector in the image or NULL */
+unsigned char *sector_ptr( int trk, int sec ) {
+    long pos;
+    if ( trk < first_track || trk >= first_track + img_tracks || sec < 0 || sec >= dpb.spt )
+        return NULL;
+    pos = (long)( xlt[ sec / log_per_phy ] - phy_base ) * psize + ( sec % log_per_phy ) * 128;
+    return track_ptr( trk ) + pos;
+}
+
+
+void open_image( const char *name ) {
+    int fd;
+    struct stat st;
+    fd = open( name, read_only ? O_RDONLY : O_RDWR );
+    if ( fd < 0 || fstat( fd, &st ) < 0 ) {
+        perror( name );
+        exit( 1 );
+    }
+    image_size = (long)st.st_size;
+    img_tracks = (int)( image_size / track_size );
+    if ( img_tracks == 0 )
+        fail( "image smaller than one track" );
+    image = mmap( NULL, (size_t)image_size, read_only ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    if ( image == MAP_FAILED ) {
+        perror( "mmap" );
+        exit( 1 );
+    }
+    close( fd );
+    track_buf = malloc( (size_t)track_size );
+    if ( !track_buf )
+        fail( "out of memory" );
+}
+
+
+/* -------------------- TRACK CRC -------------------- */
+
+uint32_t crc_table[ 256 ];
+
+
+void init_crc( void ) {
+    uint32_t c;
+    int n, k;
+    for ( n = 0; n < 256; n++ ) {
+        c = (uint32_t)n;
+        for ( k = 0; k < 8; k++ )
+            c = c & 1 ? 0xEDB88320L ^ ( c >> 1 ) : c >> 1;
+        crc_table[ n ] = c;
+    }
+}
+
+
+/* CRC-32 of one track at p, same as TrackCrc in trackio.pas */
+uint32_t track_crc( const unsigned char *p ) {
+    uint32_t c = 0xFFFFFFFFL;
+    long n;
+    for ( n = 0; n < track_size; ++n )
+        c = crc_table[ ( c ^ p[ n ] ) & 0xFF ] ^ ( c >> 8 );
+    return ~c;
+}
+
+
+void put_long( unsigned char *p, uint32_t v ) {
+    int i;
+    for ( i = 0; i < 4; ++i, v >>= 8 )
+        p[ i ] = (unsigned char)v;
+}
+
+
+uint32_t get_long( const unsigned char *p ) {
+    return p[ 0 ] | (uint32_t)p[ 1 ] << 8 | (uint32_t)p[ 2 ] << 16 | (uint32_t)p[ 3 ] << 24;
+}
+
+
+/* file name argument of a command, 0-terminated in place */
+char *file_arg( char **s ) {
+    char *name;
+    while ( isspace( (unsigned char)**s ) )
+        ++*s;
+    name = *s;
+    while ( **s && !isspace( (unsigned char)**s ) )
+        ++*s;
+    if ( **s )
+        *( *s )++ = '\0';
+    return *name ? name : NULL;
+}
+
+
+int write_crc( char *arg ) {
+    FILE *fp;
+    unsigned char rec[ 128 ];
+    int trk, n = 0;
+    char *name = file_arg( &arg );
+    if ( !name || !( fp = fopen( name, "wb" ) ) )
+        return 0;
+    memset( rec, 0, sizeof( rec ) );
+    for ( trk = first_track; trk < first_track + img_tracks; ++trk ) {
+        put_long( rec + 4 * n, track_crc( track_ptr( trk ) ) );
+        if ( ++n == 32 ) {
+            fwrite( rec, 1, sizeof( rec ), fp );
+            memset( rec, 0, sizeof( rec ) );
+            n = 0;
+        }
+    }
+    if ( n )
+        fwrite( rec, 1, sizeof( rec ), fp );
+    return fclose( fp ) == 0;
+}
+
+
+int write_update( char *arg ) {
+    FILE *cf, *uf;
+    unsigned char crc[ 4 ], hdr[ 128 ];
+    uint32_t c;
+    int trk, have, changed = 0;
+    char *crcname = file_arg( &arg );
+    char *updname = file_arg( &arg );
+    if ( !crcname || !updname || !( cf = fopen( crcname, "rb" ) ) )
+        return 0;
+    if ( !( uf = fopen( updname, "wb" ) ) ) {
+        fclose( cf );
+        return 0;
+    }
+    memset( hdr, 0, sizeof( hdr ) );
+    for ( trk = first_track; trk < first_track + img_tracks; ++trk ) {
+        have = fread( crc, 1, 4, cf ) == 4;
+        c = track_crc( track_ptr( trk ) );
+        if ( !have || get_long( crc ) != c ) { /* changed or missing */
+            hdr[ 0 ] = (unsigned char)trk;
+            hdr[ 1 ] = (unsigned char)( trk >> 8 );
+            put_long( hdr + 2, c );
+            fwrite( hdr, 1, sizeof( hdr ), uf );
+            fwrite( track_ptr( trk ), 1, (size_t)track_size, uf );
+            ++changed;
+        }
+    }
+    memset( hdr, 0, sizeof( hdr ) );
+    hdr[ 0 ] = hdr[ 1 ] = 0xFF; /* end of update file */
+    fwrite( hdr, 1, sizeof( hdr ), uf );
+    fclose( cf );
+    if ( !quiet )
+        printf( "%d changed tracks\n", changed );
+    return fclose( uf ) == 0;
+}
+
+
+int apply_update( char *arg ) {
+    FILE *uf;
+    unsigned char hdr[ 128 ];
+    int trk, ok = 0, written = 0;
+    char *name = file_arg( &arg );
+    if ( read_only || !name || !( uf = fopen( name, "rb" ) ) )
+        return 0;
+    while ( fread( hdr, 1, sizeof( hdr ), uf ) == sizeof( hdr ) ) {
+        trk = hdr[ 0 ] | hdr[ 1 ] << 8;
+        if ( trk == 0xFFFF ) {
+            ok = 1;
+            break;
+        }
+        if ( trk < first_track || trk >= first_track + img_tracks ) {
+            fprintf( stderr, "imgedit: track %d not in image\n", trk );
+            break;
+        }
+        if ( fread( track_buf, 1, (size_t)track_size, uf ) != (size_t)track_size ||
+             track_crc( track_buf ) != get_long( hdr + 2 ) ) {
+            fprintf( stderr, "imgedit: track %d: short read or CRC error\n", trk );
+            break;
+        }
+        memcpy( track_ptr( trk ), track_buf, (size_t)track_size );
+        ++written;
+    }
+    fclose( uf );
+    if ( !quiet )
+        printf( "%d tracks written\n", written );
+    return ok;
+}
+
+
+/* -------------------- COMMANDS -------------------- */
+
+/* hex and ASCII dump like DisplaySector in diskedit.pas */
+void display_sector( void ) {
+    int i, j, c;
+    if ( quiet )
+        return;
+    printf( "track %d, sector %d, phys. sector %d", track, sector, xlt[ sector / log_per_phy ] );
+    if ( log_per_phy > 1 )
+        printf( " part %d", sector % log_per_phy );
+    printf( "\n   " );
+    for ( i = 0; i < 16; ++i )
+        printf( " %02X", i );
+    printf( "\n" );
+    for ( i = 0; i < 8; ++i ) {
+        printf( "%02X:", i * 16 );
+        for ( j = 0; j < 16; ++j )
+            printf( " %02X", buf[ 16 * i + j ] );
+        printf( "   " );
+        for ( j = 0; j < 16; ++j ) {
+            c = buf[ 16 * i + j ] & 0x7F;
+            putchar( c < 32 || c == 0x7F ? '.' : c );
+        }
+        printf( "\n" );
+    }
+}
+
+
+int read_sector( int trk, int sec ) {
+    unsigned char *p = sector_ptr( trk, sec );
+    if ( !p )
+        return 0;
+    track = trk;
+    sector = sec;
+    memcpy( buf, p, 128 );
+    display_sector();
+    return 1;
+}
+
+
+int next_sector( int dir ) {
+    int trk = track, sec = sector + dir;
+    if ( track < 0 )
+        return 0;
+    if ( sec == dpb.spt ) {
+        sec = 0;
+        ++trk;
+    } else if ( sec < 0 ) {
+        sec = dpb.spt - 1;
+        --trk;
+    }
+    return read_sector( trk, sec );
+}
+
+
+int modify_sector( char *arg ) {
+    char *end;
+    long adr, val;
+    adr = strtol( arg, &end, 16 );
+    if ( end == arg || adr < 0 || adr > 0x7F )
+        return 0;
+    while ( isspace( (unsigned char)*end ) )
+        ++end;
+    if ( *end == '\'' ) { /* ASCII string */
+        for ( ++end; *end && *end != '\n' && adr < 128; ++end )
+            buf[ adr++ ] = (unsigned char)*end;
+        return 1;
+    }
+    while ( *end && adr < 128 ) { /* hex bytes */
+        arg = end;
+        val = strtol( arg, &end, 16 );
+        if ( end == arg )
+            break;
+        if ( val < 0 || val > 0xFF )
+            return 0;
+        buf[ adr++ ] = (unsigned char)val;
+    }
+    return 1;
+}
+
+
+int write_sector( void ) {
+    unsigned char *p = sector_ptr( track, sector );
+    if ( !p || read_only )
+        return 0;
+    memcpy( p, buf, 128 );
+    return 1;
+}
+
+
+/* fill tracks like Format in diskedit.pas, the directory tracks with */
+/* INITDIR timestamp entries: '!' in every record                      */
+int format_tracks( int first, int last ) {
+    int trk, i;
+    unsigned char *p;
+    if ( read_only || first > last || !sector_ptr( first, 0 ) || !sector_ptr( last, 0 ) )
+        return 0;
+    for ( trk = first; trk <= last; ++trk ) {
+        p = track_ptr( trk );
+        memset( p, 0xE5, (size_t)track_size );
+        if ( trk >= dir_track && trk < data_track )
+            for ( i = 0x60; i < track_size; i += 128 )
+                p[ i ] = 0x21; /* '!' for file date */
+    }
+    return 1;
+}
+
+
+/* execute one command line, return 0 on error, -1 on quit */
+int command( char *line ) {
+    char *arg;
+    long a, b;
+    char *end;
+    while ( isspace( (unsigned char)*line ) )
+        ++line;
+    if ( !*line || *line == '#' )
+        return 1;
+    arg = line + 1;
+    switch ( tolower( (unsigned char)*line ) ) {
+    case 'r':
+        a = strtol( arg, &end, 0 );
+        if ( end == arg )
+            return 0;
+        arg = end;
+        b = strtol( arg, &end, 0 );
+        if ( end == arg )
+            return 0;
+        return read_sector( (int)a, (int)b );
+    case 'n':
+        return next_sector( 1 );
+    case 'p':
+        return next_sector( -1 );
+    case 'd':
+        if ( track < 0 )
+            return 0;
+        display_sector();
+        return 1;
+    case 'm':
+        return track >= 0 && modify_sector( arg );
+    case 'w':
+        return track >= 0 && write_sector();
+    case 'f':
+        a = strtol( arg, &end, 0 );
+        if ( end == arg )
+            return 0;
+        arg = end;
+        b = strtol( arg, &end, 0 );
+        if ( end == arg )
+            b = a;
+        return format_tracks( (int)a, (int)b );
+    case 'i':
+        return format_tracks( dir_track, data_track - 1 );
+    case 'c':
+        return write_crc( arg );
+    case 'u':
+        return write_update( arg );
+    case 'a':
+        return apply_update( arg );
+    case 'q':
+        return -1;
+    }
+    return 0;
+}
+
+
+void usage( const char *argv0 ) {
+    printf( "CP/M disk image editor version %s\n", VERSION );
+    printf( "Usage:\n" );
+    printf( "  %s [options] image [script]\n", argv0 );
+    printf( "Options:\n" );
+    printf( "  -d SPT,BSH,BLM,EXM,DSM,DRM,OFF,PSH,PSM  disk parameter block\n" );
+    printf( "  -x S0,S1,...  sector translation table (phys. sectors), 0: none\n" );
+    printf( "  -t TRACK      first track in the image (default 0)\n" );
+    printf( "  -r            open image read only\n" );
+    printf( "  -q            quiet, do not show sectors\n" );
+    printf( "Without -d the 8\" SSSD format (26 sectors, skew 6) is used,\n" );
+    printf( "-d without -x means no skew; -d and -x may be given in any order.\n" );
+}
+
+
+/* ---------------------------------------------- */
+/* -------------------- MAIN -------------------- */
+/* ---------------------------------------------- */
+int main( int argc, char *argv[] ) {
+    int v[ 9 ], i, r, lineno = 0, interactive;
+    int have_xlt = 0; /* -x given, keep it whatever the order of -d and -x */
+    FILE *script = stdin;
+    char line[ 256 ];
+
+    for ( i = 1; i < argc && argv[ i ][ 0 ] == '-' && argv[ i ][ 1 ]; ++i ) {
+        switch ( argv[ i ][ 1 ] ) {
+        case 'd':
+            if ( ++i == argc || parse_list( argv[ i ], v, 9 ) != 9 )
+                fail( "-d needs 9 values" );
+            dpb.spt = v[ 0 ];
+            dpb.bsh = v[ 1 ];
+            dpb.blm = v[ 2 ];
+            dpb.exm = v[ 3 ];
+            dpb.dsm = v[ 4 ];
+            dpb.drm = v[ 5 ];
+            dpb.off = v[ 6 ];
+            dpb.psh = v[ 7 ];
+            dpb.psm = v[ 8 ];
+            if ( !have_xlt )
+                n_xlt = 0; /* no skew unless given with -x */
+            break;
+        case 'x':
+            if ( ++i == argc )
+                fail( "-x needs a table" );
+            n_xlt = parse_list( argv[ i ], xlt, MAX_PHYSEC );
+            have_xlt = 1;
+            if ( n_xlt == 1 && xlt[ 0 ] == 0 )
+                n_xlt = 0;
+            break;
+        case 't':
+            if ( ++i == argc )
+                fail( "-t needs a track number" );
+            first_track = atoi( argv[ i ] );
+            break;
+        case 'r':
+            read_only = 1;
+            break;
+        case 'q':
+            quiet = 1;
+            break;
+        default:
+            usage( *argv );
+            return 1;
+        }
+    }
+    if ( i == argc || i + 2 < argc ) {
+        usage( *argv );
+        return 1;
+    }
+
+    init_geometry();
+    init_crc();
+    open_image( argv[ i ] );
+    if ( i + 1 < argc ) {
+        script = fopen( argv[ i + 1 ], "r" );
+        if ( !script ) {
+            perror( argv[ i + 1 ] );
+            return 1;
+        }
+    }
+    interactive = script == stdin && isatty( 0 );
+    if ( !quiet )
+        printf( "%ld KB image, tracks %d..%d, %d dir. entries on track %d..%d, "
+                "%d byte phys. sectors\n",
+                image_size / 1024, first_track, first_track + img_tracks - 1, dpb.drm + 1,
+                dir_track, data_track - 1, psize );
+    if ( first_track + img_tracks > max_track )
+        fprintf( stderr, "imgedit: image is larger than the drive (%d tracks)\n", max_track );
+
+    r = 1;
+    while ( r > 0 ) {
+        if ( interactive ) {
+            printf( "> " );
+            fflush( stdout );
+        }
+        if ( !fgets( line, sizeof( line ), script ) )
+            break;
+        ++lineno;
+        r = command( line );
+        if ( r == 0 ) {
+            fprintf( stderr, "imgedit: line %d: invalid command or sector: %s", lineno, line );
+            if ( !interactive )
+                break;
+            r = 1;
+        }
+    }
+
+    if ( !read_only )
+        msync( image, (size_t)image_size, MS_SYNC );
+    munmap( image, (size_t)image_size );
+    if ( script != stdin )
+        fclose( script );
+    return r == 0;
+}
@@ -0,0 +1,99 @@
+{ INCLUDE-FILE SCAN.PAS: }
+{ read only surface test with time per track }
+
+{ A healthy track is read in less than a second, every second more  }
+{ is spent in BIOS retries.  The map shows the worst track of each  }
+{ group: '.' o.k., '2'..'9' seconds, '*' 10 s and more, 'E' error.  }
+
+
+Procedure Scan; { read FirstTrack .. LastTrack, never write }
+Var
+  Trk, r, Stride,
+  Per, Worst, Sec,
+  Slow, Errors,
+  Line, Col:      integer;
+  t:              real;
+  Stop:           boolean;
+
+Procedure ShowError( Trk, r: integer ); { list track and BIOS code }
+begin
+  Errors := Errors + 1;
+  if Errors <= 40 then
+    begin
+      GotoXY( 1 + 10 * ( ( Errors - 1 ) mod 8 ), USRLINE + 14 + ( Errors - 1 ) div 8 );
+      Write( Trk:5, ':' );
+      WriteHex( r )
+    end
+end;
+
+begin
+  if UserFrame( ScanTracks ) = 'N' then
+    Exit;  { user abort }
+  BufferValid := False;
+  if TrackFits then Stride := Psize else Stride := 0;
+  Per := ( LastTrack - FirstTrack ) div 512 + 1;  { 64 x 8 chars }
+  GotoXY( 1, USRLINE + 5 );
+  LowVideo;
+  Write( Per, ' track(s) per char:  . o.k.  2..9 seconds  * more  E error' );
+  HighVideo;
+  Slow := 0;
+  Errors := 0;
+  Line := USRLINE + 5;
+  Col := 0;
+  Stop := false;
+  Trk := FirstTrack;
+  while not Stop and ( Trk <= LastTrack ) do
+    begin
+      if Col mod 64 = 0 then
+        begin
+          Line := Line + 1;
+          Col := 0;
+          GotoXY( 1, Line );
+          LowVideo;
+          Write( Trk:5, ': ' );
+          HighVideo
+        end;
+      Worst := 0;                    { seconds, 255 = error }
+      r := 0;
+      while ( r < Per ) and ( Trk <= LastTrack ) do
+        begin
+          GotoXY( 1, USRLINE + 4 );    { left of the deblocking note }
+          Write( 'TEST track ', Trk:4 );
+          t := Clock;
+          i := TrackIO( 13, Trk, Stride );
+          Sec := round( Clock - t );
+          if Sec > 99 then Sec := 99;
+          if i <> 0 then
+            begin
+              ShowError( Trk, i );
+              Sec := 255
+            end
+          else if Sec >= 2 then
+            Slow := Slow + 1;
+          if Sec > Worst then Worst := Sec;
+          Trk := Trk + 1;
+          r := r + 1
+        end;
+      GotoXY( 8 + Col, Line );
+      if Worst = 255 then
+        Write( 'E' )
+      else if Worst >= 10 then
+        Write( '*' )
+      else if Worst >= 2 then
+        Write( Worst )
+      else
+        Write( '.' );
+      Col := Col + 1;
+      if KeyPressed then             { user interrupt }
+        begin
+          Read( Kbd, c );
+          Stop := true
+        end
+    end;
+
+  GotoXY( 1, USRLINE + 4 );
+  ClrEol;
+  if Stop then
+    Write( 'Stopped at track ', Trk - 1, ', ' );
+  Write( Slow, ' slow tracks, ', Errors, ' read errors' )
+end;
@@ -0,0 +1,160 @@
+{ INCLUDE-FILE SEARCH.PAS: }
+{ search tracks for a hex or ASCII pattern }
+
+{ The logical sectors are scanned in order, each one together with the }
+{ last PatLen-1 bytes of the sector before, so a match across sector  }
+{ and track boundaries is found, too.  The matcher uses a skip table  }
+{ (Boyer-Moore-Horspool) on the last byte of the window.              }
+
+
+Const
+  MaxPat = 32;  { max pattern length }
+
+Procedure Search; { search FirstTrack .. LastTrack for a pattern }
+Var
+  Pat:                array [1..MaxPat] of byte;
+  Win:                array [1..159] of byte;   { MaxPat-1 + 128 }
+  Skip:               array [0..255] of byte;
+  PatLen, Carry,
+  Trk, s, p, n,
+  PrevTrk, PrevSec,
+  Hits, Line, Col:    integer;
+  st:                 string[80];
+  hx:                 string[2];
+  Ok, Stop:           boolean;
+
+Procedure Hit( t, s, o: integer ); { show track / sector / offset }
+begin
+  if Hits = 0 then
+    begin           { first hit becomes the current sector }
+      Track := t;
+      Lsector := s
+    end;
+  Hits := Hits + 1;
+  if Line < BOTLINE then
+    begin
+      GotoXY( Col, Line );
+      Write( t:5, '/', s:3, '/' );
+      WriteHex( o );
+      Col := Col + 13;
+      if Col > 66 then
+        begin
+          Col := 1;
+          Line := Line + 1
+        end
+    end
+end;
+
+begin
+  if UserFrame( SearchTracks ) = 'N' then
+    Exit;  { user abort }
+  BufferValid := False;
+  GotoXY( 1, USRLINE + 6 );
+  if not TrackFits then
+    begin
+      Write( 'Track too large for buffer.' );
+      Exit
+    end;
+
+  GotoXY( 1, USRLINE + 4 );         { same syntax as ModifySector }
+  Write( 'PATTERN  hex bytes or ''ASCII: ' );
+  readln( st );
+  PatLen := 0;
+  if length( st ) > 0 then
+    if st[1] = '''' then
+      begin
+        for i := 2 to length( st ) do
+          if PatLen < MaxPat then
+            begin
+              PatLen := PatLen + 1;
+              Pat[PatLen] := ord( st[i] )
+            end
+      end
+    else
+      begin
+        st := st + ' ';
+        hx := '';
+        for i := 1 to length( st ) do
+          if st[i] <> ' ' then
+            begin
+              if length( hx ) = 2 then hx := hx[2];
+              hx := hx + st[i]
+            end
+          else if hx <> '' then
+            begin
+              if ( PatLen < MaxPat ) and ( HexVal( hx ) < 256 ) then
+                begin
+                  PatLen := PatLen + 1;
+                  Pat[PatLen] := HexVal( hx )
+                end;
+              hx := ''
+            end
+      end;
+  if PatLen = 0 then
+    Exit;
+
+  for i := 0 to 255 do               { skip table }
+    Skip[i] := PatLen;
+  for i := 1 to PatLen - 1 do
+    Skip[Pat[i]] := PatLen - i;
+
+  GotoXY( 1, USRLINE + 5 );
+  LowVideo;
+  Write( 'TRACK/SECTOR/OFFSET of hits, any key stops' );
+  HighVideo;
+  Hits := 0;
+  Line := USRLINE + 6;
+  Col := 1;
+  Carry := 0;                        { bytes from the sector before }
+  Ok := true;
+  Stop := false;
+  Trk := FirstTrack;
+  while Ok and not Stop and ( Trk <= LastTrack ) do
+    begin
+      GotoXY( 50, USRLINE + 4 );
+      Write( 'SEARCH track ', Trk:3 );
+      Ok := TrackIO( 13, Trk, Psize ) = 0;
+      s := 0;
+      while Ok and ( s < MaxSector ) do
+        begin
+          p := 1 + ( SkewTab[s div LogPerPhy] - PhyBase ) * Psize
+                 + ( s mod LogPerPhy ) * 128;
+          Move( TrackBuf[p], Win[Carry+1], 128 );
+          n := Carry + 128;          { bytes in the window }
+          i := 0;                    { match position - 1 }
+          while i <= n - PatLen do
+            begin
+              p := PatLen;
+              while ( p > 0 ) and ( Win[i+p] = Pat[p] ) do
+                p := p - 1;
+              if p = 0 then
+                if i < Carry then    { starts in the sector before }
+                  Hit( PrevTrk, PrevSec, 128 - Carry + i )
+                else
+                  Hit( Trk, s, i - Carry );
+              i := i + Skip[Win[i+PatLen]]
+            end;
+          Carry := PatLen - 1;       { keep the tail for the next one }
+          Move( Win[n-Carry+1], Win[1], Carry );
+          PrevTrk := Trk;
+          PrevSec := s;
+          s := s + 1
+        end;
+      if KeyPressed then             { user interrupt }
+        begin
+          Read( Kbd, c );
+          Stop := true
+        end;
+      Trk := Trk + 1
+    end;
+
+  GotoXY( 1, USRLINE + 5 );
+  ClrEol;
+  if not Ok then
+    Write( 'Read error at track ', Trk - 1, ', ' )
+  else if Stop then
+    Write( 'Stopped at track ', Trk - 1, ', ' );
+  Write( Hits, ' hits' );
+  if Hits > 0 then
+    Write( ', READ shows the first' )
+end;
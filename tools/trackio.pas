@@ -0,0 +1,244 @@
+{ INCLUDE-FILE TRACKIO.PAS: }
+{ whole track transfers via BIOS multi sector I/O, track CRC-32 }
+
+
+Const
+  MaxTrackSize = 16384; { track buffer, e.g. 32 phys. sectors of 512 byte }
+  MaxPhySec = 255;      { max phys. sectors per track }
+
+Var
+  TrackBuf:   array [1..MaxTrackSize] of byte;
+  SkewTab:    array [0..MaxPhySec] of integer; { log. -> phys. sector }
+  AccTab:     array [0..MaxPhySec] of integer; { phys. sector access order }
+  Interleave: integer;      { 0: SkewTab order, else every n-th sector }
+  PhySecs,                  { phys. sectors per track             }
+  PhyBase:    integer;      { lowest phys. sector number (0 or 1) }
+  TrackFits:  boolean;      { whole track fits into TrackBuf      }
+  CrcTab:     array [0..1023] of byte;  { CRC-32 table, 4 byte LSB first }
+  CrcReady:   boolean;      { CrcTab is initialised               }
+  CrcLo, CrcHi,             { CRC-32 value                        }
+  CrcAdr, CrcCnt: integer;  { data block for UpdCrc               }
+
+
+Procedure InitOrder; { sector access order for the selected Interleave }
+Var
+  s, p: integer;
+  Used: array [0..MaxPhySec] of boolean;
+begin
+  if Interleave = 0 then
+    for s := 0 to PhySecs - 1 do
+      AccTab[s] := SkewTab[s]
+  else
+    begin
+      for s := 0 to PhySecs - 1 do
+        Used[s] := false;
+      p := 0;
+      for s := 0 to PhySecs - 1 do
+        begin
+          while Used[p] do              { slot taken, use the next one }
+            p := ( p + 1 ) mod PhySecs;
+          Used[p] := true;
+          AccTab[s] := PhyBase + p;
+          p := ( p + Interleave ) mod PhySecs
+        end
+    end
+end;
+
+
+Procedure InitSkew; { build the sector skew table of the selected drive }
+Var
+  dph, xlt, s: integer;
+begin
+  dph := UBIOS( 9, 0, Drive, 1, 0 );    { select disk, get DPH   }
+  xlt := Mem[dph] + Mem[dph+1] shl 8;   { sector translate table }
+  PhySecs := MaxSector div LogPerPhy;
+  if PhySecs > MaxPhySec + 1 then
+    PhySecs := MaxPhySec + 1;
+  PhyBase := MaxInt;
+  for s := 0 to PhySecs - 1 do
+    begin
+      SkewTab[s] := UBIOS( 16, 0, s, xlt, 0 );  { SECTRAN }
+      if SkewTab[s] < PhyBase then PhyBase := SkewTab[s]
+    end;
+  TrackFits := PhySecs <= MaxTrackSize div Psize;
+  if Interleave >= PhySecs then
+    Interleave := 0;
+  InitOrder
+end;
+
+
+Function TrackIO( Fn, Trk, Stride: integer ): integer;
+{ read (Fn = 13) or write (Fn = 14) all phys. sectors of track Trk.    }
+{ The sectors are placed in TrackBuf in physical order, Stride bytes   }
+{ apart; Stride = 0 transfers the same sector buffer again and again.  }
+{ The track is set once, the sectors are accessed in the order of      }
+{ AccTab.  SETBNK follows each SETDMA, as a BIOS may reset the DMA     }
+{ bank in SETDMA.  MULTIO announces groups of up to 255 sectors; all   }
+{ sectors of a group are transferred, a failing group ends the track.  }
+{ With Stride > 0 only sectors that fit into TrackBuf are transferred, }
+{ the callers check TrackFits.                                         }
+{ Returns 0 or the BIOS error code of the first failing sector.        }
+Var
+  s, n, Fit, Cnt, r, e: integer;
+begin
+  r := UBIOS( 9, 0, Drive, 1, 0 );             { select disk again, }
+                                               { BDOS file I/O may  }
+                                               { have changed it    }
+  if Stride > 0 then
+    Fit := MaxTrackSize div Stride             { sectors in TrackBuf }
+  else
+    Fit := PhySecs;
+  r := UBIOS( 10, 0, Trk, 0, 0 );              { select track       }
+  e := 0;
+  s := 0;
+  while ( s < PhySecs ) and ( e = 0 ) do
+    begin
+      Cnt := 0;                                { next group         }
+      n := s;
+      while ( n < PhySecs ) and ( Cnt < 255 ) do
+        begin
+          if AccTab[n] - PhyBase < Fit then Cnt := Cnt + 1;
+          n := n + 1
+        end;
+      if Cnt > 0 then
+        r := UBIOS( 23, 0, Cnt, 0, 0 );        { execute Cnt sectors }
+      while s < n do
+        begin
+          if AccTab[s] - PhyBase < Fit then
+            begin
+              r := UBIOS( 11, 0, AccTab[s], 0, 0 );    { select sector      }
+              r := UBIOS( 12, 0, Addr( TrackBuf[ 1 + ( AccTab[s] - PhyBase ) * Stride ] ), 0, 0 );
+              r := UBIOS( 28, 1, 0, 0, 0 );            { select RAM bank    }
+              r := UBIOS( Fn, 0, 0, 0, 0 );            { read / write       }
+              if e = 0 then e := r
+            end;
+          s := s + 1
+        end
+    end;
+  TrackIO := e
+end;
+
+
+Procedure InitCrc; { build CRC-32 table for polynomial $EDB88320 }
+Var
+  n, b, wl, wh: integer;
+  c:            boolean;
+begin
+  for n := 0 to 255 do
+    begin
+      wl := n;
+      wh := 0;
+      for b := 1 to 8 do
+        begin
+          c := odd( wl );
+          wl := ( wl shr 1 ) or ( wh shl 15 );
+          wh := wh shr 1;
+          if c then
+            begin
+              wl := wl xor $8320;
+              wh := wh xor $EDB8
+            end
+        end;
+      CrcTab[4*n]   := Lo( wl );
+      CrcTab[4*n+1] := Hi( wl );
+      CrcTab[4*n+2] := Lo( wh );
+      CrcTab[4*n+3] := Hi( wh )
+    end;
+  CrcReady := true
+end;
+
+
+Procedure UpdCrc; { update CrcLo/CrcHi with CrcCnt bytes at CrcAdr }
+begin
+  inline( $2A/CrcAdr/          {       ld   hl,(CrcAdr)  }
+          $ED/$4B/CrcCnt/      {       ld   bc,(CrcCnt)  }
+          $78/                 { loop: ld   a,b          }
+          $B1/                 {       or   c            }
+          $28/$30/             {       jr   z,done       }
+          $C5/                 {       push bc           }
+          $7E/                 {       ld   a,(hl)       }
+          $23/                 {       inc  hl           }
+          $E5/                 {       push hl           }
+          $ED/$4B/CrcLo/       {       ld   bc,(CrcLo)   }
+          $A9/                 {       xor  c            }
+          $6F/                 {       ld   l,a          }
+          $26/$00/             {       ld   h,0          }
+          $29/                 {       add  hl,hl        }
+          $29/                 {       add  hl,hl        }
+          $11/CrcTab/          {       ld   de,CrcTab    }
+          $19/                 {       add  hl,de        }
+          $ED/$5B/CrcHi/       {       ld   de,(CrcHi)   }
+          $7E/                 {       ld   a,(hl)       }
+          $A8/                 {       xor  b            }
+          $4F/                 {       ld   c,a          }
+          $23/                 {       inc  hl           }
+          $7E/                 {       ld   a,(hl)       }
+          $AB/                 {       xor  e            }
+          $47/                 {       ld   b,a          }
+          $23/                 {       inc  hl           }
+          $7E/                 {       ld   a,(hl)       }
+          $AA/                 {       xor  d            }
+          $5F/                 {       ld   e,a          }
+          $23/                 {       inc  hl           }
+          $56/                 {       ld   d,(hl)       }
+          $ED/$43/CrcLo/       {       ld   (CrcLo),bc   }
+          $ED/$53/CrcHi/       {       ld   (CrcHi),de   }
+          $E1/                 {       pop  hl           }
+          $C1/                 {       pop  bc           }
+          $0B/                 {       dec  bc           }
+          $18/$CC )            {       jr   loop         }
+end;                           { done:                   }
+
+
+Procedure TrackCrc( Size: integer ); { CRC-32 of Size bytes in TrackBuf }
+begin
+  if not CrcReady then
+    InitCrc;
+  CrcLo := -1;
+  CrcHi := -1;
+  CrcAdr := Addr( TrackBuf );
+  CrcCnt := Size;
+  UpdCrc;
+  CrcLo := not CrcLo;
+  CrcHi := not CrcHi
+end;
+
+
+Function Clock: real; { seconds from the CP/M 3 clock, BDOS 105 }
+Var
+  DAT: record
+    Days:      integer;  { days since 1.1.1978 }
+    Hour, Min: byte      { BCD                 }
+  end;
+  Sec: byte;
+
+Function BCD( b: byte ): integer;
+begin
+  BCD := ( b shr 4 ) * 10 + ( b and $0F )
+end;
+
+begin
+  Sec := Bdos( 105, Addr( DAT ) );
+  with DAT do
+    Clock := ( ( Days * 24.0 + BCD( Hour ) ) * 60.0 + BCD( Min ) ) * 60.0 + BCD( Sec )
+end;
+
+
+Function Tick( Var t: real ): boolean;
+{ wait for the next second of the clock, t is the new time; false if  }
+{ the clock doesn't change within TickPolls polls, e.g. without RTC   }
+Const
+  TickPolls = 400;  { 5 ms apart, 2 seconds }
+Var
+  t0: real;
+  n:  integer;
+begin
+  t0 := Clock;
+  n := 0;
+  repeat
+    Delay( 5 );
+    t := Clock;
+    n := n + 1
+  until ( t <> t0 ) or ( n >= TickPolls );
+  Tick := t <> t0
+end;